@@ -0,0 +1,959 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * rmem-bench: drive test_rmem_transfer benchmarks from userspace
+ * Author: Kunihiko Hayashi <hayashi.kunihiko@socionext.com>
+ *
+ * Runs a matrix of named scenarios through the module's debugfs control
+ * interface, prints the results as a table, optionally writes them as
+ * JSON and compares them against a JSON baseline.  With -w it instead
+ * follows the module's telemetry stream for a number of seconds, with -m
+ * it benchmarks userspace mappings of the reserved region, with -f it
+ * times fenced copies from submission to the sync_file signalling, with
+ * -S it compares read/write, splice and sendfile into the region, and
+ * with -N it onlines the node the module hotplugged the region into and
+ * compares memcpy between that node and normal RAM.
+ */
+
+#define _GNU_SOURCE
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <linux/perf_event.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEFAULT_DEBUGFS	"/sys/kernel/debug/test-rmem-transfer"
+#define PARAM_DIR	"/sys/module/test_rmem_transfer/parameters"
+
+#define MAX_RESULTS	1024
+
+static const struct scenario {
+	const char *name;
+	unsigned int type;
+} scenarios[] = {
+	{ "sched",	0x04 },
+	{ "numa",	0x08 },
+	{ "survey",	0x10 },
+	{ "slave",	0x20 },
+	{ "tune",	0x40 },
+	{ "fused",	0x80 },
+	{ "sized",	0x100 },
+	{ "telem",	0x200 },
+	{ "rt",		0x400 },
+	{ "submit",	0x800 },
+	{ "percpu",	0x1000 },
+	{ "huge",	0x2000 },
+	{ "fence",	0x4000 },
+	{ "async",	0x8000 },
+	{ "pm",		0x10000 },
+	{ "replay",	0x20000 },
+	{ "sample",	0x40000 },
+	{ "node",	0x80000 },
+	{ "heat",	0x100000 },
+};
+
+#define NR_SCENARIOS	(sizeof(scenarios) / sizeof(scenarios[0]))
+
+struct result {
+	char scenario[32];
+	char name[64];
+	unsigned long size;
+	unsigned int n;
+	unsigned long long min, avg, max;
+	unsigned long long mbps;
+};
+
+static struct result results[MAX_RESULTS];
+static int nr_results;
+
+static int write_file(const char *path, const char *val)
+{
+	FILE *fp;
+	int ret = 0;
+
+	fp = fopen(path, "w");
+	if (!fp) {
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		return -1;
+	}
+	if (fputs(val, fp) < 0)
+		ret = -1;
+	if (fclose(fp))
+		ret = -1;
+	if (ret)
+		fprintf(stderr, "%s: write failed: %s\n", path, strerror(errno));
+
+	return ret;
+}
+
+static int run_scenario(const char *dir, const struct scenario *sc)
+{
+	char path[256], type[16], line[256];
+	struct result *res;
+	FILE *fp;
+
+	snprintf(path, sizeof(path), "%s/run", dir);
+	snprintf(type, sizeof(type), "%u", sc->type);
+	if (write_file(path, type))
+		return -1;
+
+	snprintf(path, sizeof(path), "%s/results", dir);
+	fp = fopen(path, "r");
+	if (!fp) {
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	/* "size samples min avg max MB/s name" */
+	while (fgets(line, sizeof(line), fp) && nr_results < MAX_RESULTS) {
+		res = &results[nr_results];
+		if (sscanf(line, "%lu %u %llu %llu %llu %llu %63[^\n]",
+			   &res->size, &res->n, &res->min, &res->avg,
+			   &res->max, &res->mbps, res->name) != 7)
+			continue;
+		snprintf(res->scenario, sizeof(res->scenario), "%s", sc->name);
+		nr_results++;
+	}
+	fclose(fp);
+
+	return 0;
+}
+
+static void print_table(void)
+{
+	struct result *res;
+	int i;
+
+	printf("%-8s %-28s %9s %10s %10s %10s %8s\n", "scenario", "name",
+	       "size", "min(ns)", "avg(ns)", "max(ns)", "MB/s");
+	for (i = 0; i < nr_results; i++) {
+		res = &results[i];
+		printf("%-8s %-28s %9lu %10llu %10llu %10llu %8llu\n",
+		       res->scenario, res->name, res->size, res->min, res->avg,
+		       res->max, res->mbps);
+	}
+}
+
+#define JSON_FMT \
+	"{\"scenario\":\"%s\",\"name\":\"%s\",\"size\":%lu,\"n\":%u," \
+	"\"min_ns\":%llu,\"avg_ns\":%llu,\"max_ns\":%llu,\"mbps\":%llu}"
+#define JSON_SCAN \
+	"{\"scenario\":\"%31[^\"]\",\"name\":\"%63[^\"]\",\"size\":%lu,\"n\":%u," \
+	"\"min_ns\":%llu,\"avg_ns\":%llu,\"max_ns\":%llu,\"mbps\":%llu}"
+
+static int write_json(const char *path)
+{
+	struct result *res;
+	FILE *fp;
+	int i;
+
+	fp = fopen(path, "w");
+	if (!fp) {
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	/* one record per line, so the baseline can be read back by scanf */
+	fprintf(fp, "[\n");
+	for (i = 0; i < nr_results; i++) {
+		res = &results[i];
+		fprintf(fp, JSON_FMT "%s\n", res->scenario, res->name,
+			res->size, res->n, res->min, res->avg, res->max,
+			res->mbps, i + 1 < nr_results ? "," : "");
+	}
+	fprintf(fp, "]\n");
+
+	return fclose(fp) ? -1 : 0;
+}
+
+static int compare_baseline(const char *path, unsigned int tol)
+{
+	struct result base, *res;
+	char line[512];
+	int i, found, regressions = 0;
+	FILE *fp;
+
+	fp = fopen(path, "r");
+	if (!fp) {
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	for (i = 0; i < nr_results; i++) {
+		res = &results[i];
+		found = 0;
+
+		rewind(fp);
+		while (fgets(line, sizeof(line), fp)) {
+			if (sscanf(line, JSON_SCAN, base.scenario, base.name,
+				   &base.size, &base.n, &base.min, &base.avg,
+				   &base.max, &base.mbps) != 8)
+				continue;
+			if (strcmp(base.scenario, res->scenario) ||
+			    strcmp(base.name, res->name) || base.size != res->size)
+				continue;
+			found = 1;
+			break;
+		}
+
+		if (!found) {
+			printf("NEW: %s %s %lu\n", res->scenario, res->name,
+			       res->size);
+			continue;
+		}
+
+		if (res->mbps * 100 < base.mbps * (100 - tol)) {
+			printf("REGRESSION: %s %s %lu bandwidth %llu -> %llu MB/s\n",
+			       res->scenario, res->name, res->size, base.mbps,
+			       res->mbps);
+			regressions++;
+		}
+		if (res->avg * 100 > base.avg * (100 + tol)) {
+			printf("REGRESSION: %s %s %lu latency %llu -> %llu ns\n",
+			       res->scenario, res->name, res->size, base.avg,
+			       res->avg);
+			regressions++;
+		}
+	}
+	fclose(fp);
+
+	printf("%d regression(s) against %s (tolerance %u%%)\n", regressions,
+	       path, tol);
+
+	return regressions;
+}
+
+/*
+ * Layout of the module's relay stream: TEST_STREAM_NR_SUBBUF sub-buffers of
+ * TEST_STREAM_SUBBUF bytes holding fixed-size samples, seq 0 is an empty slot.
+ */
+#define STREAM_SIZE	(16 * 4096)
+
+struct stream_sample {
+	unsigned long long seq;
+	unsigned long long ts_ns;
+	unsigned long long interval_ns;
+	unsigned long long bytes;
+	unsigned long long ops;
+	unsigned long long errors;
+	unsigned long long p50_ns;
+	unsigned long long p99_ns;
+};
+
+#define STREAM_SLOTS	(STREAM_SIZE / sizeof(struct stream_sample))
+
+static int cmp_seq(const void *a, const void *b)
+{
+	const struct stream_sample *x = a, *y = b;
+
+	return x->seq < y->seq ? -1 : x->seq > y->seq;
+}
+
+static int watch_stream(const char *dir, unsigned int secs)
+{
+	static struct stream_sample ring[STREAM_SLOTS], fresh[STREAM_SLOTS];
+	unsigned long long last = 0, mbps;
+	const struct stream_sample *map;
+	unsigned int i, n, polls;
+	char path[256];
+	int fd;
+
+	snprintf(path, sizeof(path), "%s/stream0", dir);
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		return -1;
+	}
+	map = mmap(NULL, STREAM_SIZE, PROT_READ, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED) {
+		fprintf(stderr, "%s: mmap: %s\n", path, strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	printf("%8s %12s %12s %10s %6s %8s %10s %10s\n", "seq", "time(ms)",
+	       "bytes", "ops", "errors", "MB/s", "p50(ns)", "p99(ns)");
+
+	/* poll the mapping ten times a second, no syscall per sample */
+	for (polls = 0; polls < secs * 10; polls++) {
+		memcpy(ring, map, sizeof(ring));
+		for (i = 0, n = 0; i < STREAM_SLOTS; i++)
+			if (ring[i].seq > last)
+				fresh[n++] = ring[i];
+		qsort(fresh, n, sizeof(fresh[0]), cmp_seq);
+
+		for (i = 0; i < n; i++) {
+			mbps = fresh[i].interval_ns ?
+			       fresh[i].bytes * 1000 / fresh[i].interval_ns : 0;
+			printf("%8llu %12llu %12llu %10llu %6llu %8llu %10llu %10llu\n",
+			       fresh[i].seq, fresh[i].ts_ns / 1000000,
+			       fresh[i].bytes, fresh[i].ops, fresh[i].errors,
+			       mbps, fresh[i].p50_ns, fresh[i].p99_ns);
+			last = fresh[i].seq;
+		}
+		fflush(stdout);
+		usleep(100000);
+	}
+
+	munmap((void *)map, STREAM_SIZE);
+	close(fd);
+
+	return 0;
+}
+
+/*
+ * Scan the region mapped through /dev/rmem-<device>, once with page-sized
+ * and once with block mappings (mmap_huge), sequentially and at random
+ * pages, counting dTLB read misses of this process.  The huge pass asks
+ * for THP with madvise(), since with THP set to madvise the kernel won't
+ * try block mappings otherwise, and reads mmap_huge_maps to tell whether
+ * it got any.
+ */
+static int tlb_counter(void)
+{
+	struct perf_event_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.type = PERF_TYPE_HW_CACHE;
+	attr.size = sizeof(attr);
+	attr.config = PERF_COUNT_HW_CACHE_DTLB |
+		      (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+		      (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+	attr.exclude_kernel = 1;
+
+	return syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static unsigned long long tlb_read(int fd)
+{
+	unsigned long long val = 0;
+
+	if (fd < 0 || read(fd, &val, sizeof(val)) != sizeof(val))
+		return 0;
+
+	return val;
+}
+
+static void scan_map(const volatile unsigned long long *map, size_t size,
+		     int random)
+{
+	size_t i, nr = size / 4096, words = 4096 / sizeof(*map);
+	unsigned int seed = 0x52484d54;
+
+	if (!random) {
+		for (i = 0; i < size / sizeof(*map); i++)
+			(void)map[i];
+		return;
+	}
+
+	for (i = 0; i < nr; i++)
+		(void)map[(rand_r(&seed) % nr) * words + rand_r(&seed) % words];
+}
+
+static unsigned long long read_param(const char *name)
+{
+	char path[128];
+	unsigned long long val = 0;
+	FILE *fp;
+
+	snprintf(path, sizeof(path), PARAM_DIR "/%s", name);
+	fp = fopen(path, "r");
+	if (!fp)
+		return 0;
+	if (fscanf(fp, "%llu", &val) != 1)
+		val = 0;
+	fclose(fp);
+
+	return val;
+}
+
+static int mmap_bench(const char *path)
+{
+	static const char * const pattern[] = { "seq", "rand" };
+	unsigned long long ns, tlb0, tlb1, bytes, maps0;
+	struct timespec t0, t1;
+	int fd, tlb, huge, random;
+	void *map;
+	off_t size;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		return -1;
+	}
+	size = lseek(fd, 0, SEEK_END);
+	if (size <= 0) {
+		fprintf(stderr, "%s: no region size\n", path);
+		close(fd);
+		return -1;
+	}
+
+	tlb = tlb_counter();
+	printf("%-8s %-6s %12s %8s %14s\n", "mapping", "access", "bytes",
+	       "MB/s", "dTLB-misses");
+	for (huge = 0; huge < 2; huge++) {
+		if (write_file(PARAM_DIR "/mmap_huge", huge ? "1" : "0"))
+			break;
+		/* a fresh mapping, so the faults see the new setting */
+		map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+		if (map == MAP_FAILED) {
+			fprintf(stderr, "%s: mmap: %s\n", path, strerror(errno));
+			break;
+		}
+		if (huge && madvise(map, size, MADV_HUGEPAGE))
+			fprintf(stderr, "%s: madvise: %s\n", path,
+				strerror(errno));
+		maps0 = read_param("mmap_huge_maps");
+		for (random = 0; random < 2; random++) {
+			/* first pass faults the mapping in, the second is timed */
+			scan_map(map, size, random);
+			tlb0 = tlb_read(tlb);
+			clock_gettime(CLOCK_MONOTONIC, &t0);
+			scan_map(map, size, random);
+			clock_gettime(CLOCK_MONOTONIC, &t1);
+			tlb1 = tlb_read(tlb);
+
+			ns = (t1.tv_sec - t0.tv_sec) * 1000000000ULL +
+			     t1.tv_nsec - t0.tv_nsec;
+			bytes = random ? size / 4096 * 8 : size;
+			printf("%-8s %-6s %12llu %8llu ", huge ? "huge" : "4k",
+			       pattern[random], bytes, ns ? bytes * 1000 / ns : 0);
+			if (tlb < 0)
+				printf("%14s\n", "n/a");
+			else
+				printf("%14llu\n", tlb1 - tlb0);
+		}
+		if (huge && read_param("mmap_huge_maps") == maps0)
+			printf("huge: no block mappings, the pass above used 4k pages\n");
+		munmap(map, size);
+	}
+
+	if (tlb >= 0)
+		close(tlb);
+	close(fd);
+
+	return 0;
+}
+
+/*
+ * Fenced copies through /dev/rmem-<device>: each TEST_IOC_COPY returns a
+ * sync_file fd that polls readable once the copy is done.  The ABI below
+ * mirrors the module.
+ */
+#define IOC_TO_FIX	0
+#define IOC_FROM_FIX	1
+
+struct ioc_copy {
+	unsigned int dir;
+	unsigned int flags;
+	unsigned long long offset;
+	unsigned long long len;
+	int fence_fd;
+	unsigned int pad;
+};
+
+#define IOC_COPY	_IOWR('R', 0x01, struct ioc_copy)
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int fence_bench(const char *path, unsigned long long len,
+		       unsigned int loops)
+{
+	unsigned long long t0, ns, min = ~0ULL, max = 0, sum = 0;
+	struct ioc_copy req;
+	struct pollfd pfd;
+	unsigned int i;
+	int fd, ret = 0;
+
+	fd = open(path, O_RDWR);
+	if (fd < 0) {
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	for (i = 0; i < loops; i++) {
+		memset(&req, 0, sizeof(req));
+		req.dir = i & 1 ? IOC_FROM_FIX : IOC_TO_FIX;
+		req.len = len;
+
+		t0 = now_ns();
+		if (ioctl(fd, IOC_COPY, &req)) {
+			fprintf(stderr, "%s: copy: %s\n", path, strerror(errno));
+			ret = -1;
+			break;
+		}
+		pfd.fd = req.fence_fd;
+		pfd.events = POLLIN;
+		if (poll(&pfd, 1, 3000) != 1) {
+			fprintf(stderr, "%s: fence did not signal\n", path);
+			close(req.fence_fd);
+			ret = -1;
+			break;
+		}
+		ns = now_ns() - t0;
+		close(req.fence_fd);
+
+		min = ns < min ? ns : min;
+		max = ns > max ? ns : max;
+		sum += ns;
+	}
+
+	if (i)
+		printf("fence copy+poll %llu bytes x%u: min %llu avg %llu max %llu ns\n",
+		       len, i, min, sum / i, max);
+	close(fd);
+
+	return ret;
+}
+
+/*
+ * Feed the upper half of the region (clear of the calibration page and
+ * fixmem) from a memfd: through a bounce buffer, through a pipe with
+ * splice, with sendfile, and back out of the region through a pipe.
+ */
+#define SPLICE_CHUNK	(64 * 1024)
+
+static int splice_pass(int method, int in, loff_t in_off, int out,
+		       loff_t out_off, int *pipefd, char *buf)
+{
+	loff_t end = in_off + SPLICE_CHUNK;
+	ssize_t n;
+
+	if (method == 2 && lseek(out, out_off, SEEK_SET) < 0)
+		return -1;
+
+	while (in_off < end) {
+		switch (method) {
+		case 0:
+			n = pread(in, buf, end - in_off, in_off);
+			if (n > 0)
+				n = pwrite(out, buf, n, out_off);
+			in_off += n > 0 ? n : 0;
+			out_off += n > 0 ? n : 0;
+			break;
+		case 2:
+			/* sendfile advances in_off and the file position */
+			n = sendfile(out, in, &in_off, end - in_off);
+			break;
+		default:
+			/* splice advances both offsets itself */
+			n = splice(in, &in_off, pipefd[1], NULL, end - in_off,
+				   SPLICE_F_MOVE);
+			if (n > 0)
+				n = splice(pipefd[0], NULL, out, &out_off, n,
+					   SPLICE_F_MOVE);
+			break;
+		}
+		if (n <= 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+static int splice_bench(const char *path)
+{
+	static const char * const method[] = {
+		"read/write", "splice", "sendfile", "splice-out",
+	};
+	unsigned long long t0, ns, bytes;
+	int fd, mfd, pipefd[2], m, ret = 0;
+	off_t size, base, off;
+	char *buf;
+
+	fd = open(path, O_RDWR);
+	if (fd < 0) {
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		return -1;
+	}
+	size = lseek(fd, 0, SEEK_END);
+	base = size / 2 / SPLICE_CHUNK * SPLICE_CHUNK;
+	if (size - base < SPLICE_CHUNK) {
+		fprintf(stderr, "%s: region too small\n", path);
+		close(fd);
+		return -1;
+	}
+	size -= (size - base) % SPLICE_CHUNK;
+
+	mfd = memfd_create("rmem-bench", 0);
+	buf = malloc(SPLICE_CHUNK);
+	if (mfd < 0 || !buf || pipe(pipefd) ||
+	    ftruncate(mfd, size - base)) {
+		fprintf(stderr, "splice setup: %s\n", strerror(errno));
+		close(fd);
+		return -1;
+	}
+	memset(buf, 0x5a, SPLICE_CHUNK);
+	for (off = 0; off < size - base; off += SPLICE_CHUNK)
+		if (pwrite(mfd, buf, SPLICE_CHUNK, off) != SPLICE_CHUNK)
+			ret = -1;
+
+	printf("%-12s %12s %8s\n", "method", "bytes", "MB/s");
+	for (m = 0; m < 4 && !ret; m++) {
+		bytes = 0;
+		t0 = now_ns();
+		for (off = 0; off < size - base; off += SPLICE_CHUNK) {
+			if (m == 3)
+				ret = splice_pass(m, fd, base + off, mfd, off,
+						  pipefd, buf);
+			else
+				ret = splice_pass(m, mfd, off, fd, base + off,
+						  pipefd, buf);
+			if (ret) {
+				fprintf(stderr, "%s: %s: %s\n", path, method[m],
+					strerror(errno));
+				break;
+			}
+			bytes += SPLICE_CHUNK;
+		}
+		ns = now_ns() - t0;
+		if (!ret)
+			printf("%-12s %12llu %8llu\n", method[m], bytes,
+			       ns ? bytes * 1000 / ns : 0);
+	}
+
+	close(pipefd[0]);
+	close(pipefd[1]);
+	close(mfd);
+	free(buf);
+	close(fd);
+
+	return ret;
+}
+
+/*
+ * The region as a CPU-less node (rmem_node): online its memory blocks as
+ * movable, then time memcpy between buffers bound to it and to the node
+ * we run on, as an application run under numactl --membind would see.
+ */
+#define NODE_DIR	"/sys/devices/system/node"
+#define NODE_BUF	(64UL << 20)
+#define NODE_LOOPS	16
+#define MPOL_BIND	2
+
+static int node_online(int node)
+{
+	char path[300], state[32];
+	struct dirent *de;
+	int n = 0, ret = 0;
+	DIR *dir;
+	FILE *fp;
+
+	snprintf(path, sizeof(path), NODE_DIR "/node%d", node);
+	dir = opendir(path);
+	if (!dir) {
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		return -1;
+	}
+	while ((de = readdir(dir))) {
+		if (strncmp(de->d_name, "memory", 6) ||
+		    de->d_name[6] < '0' || de->d_name[6] > '9')
+			continue;
+		snprintf(path, sizeof(path), NODE_DIR "/node%d/%.32s/state", node,
+			 de->d_name);
+		fp = fopen(path, "r");
+		if (!fp || !fgets(state, sizeof(state), fp))
+			state[0] = 0;
+		if (fp)
+			fclose(fp);
+		if (!strncmp(state, "offline", 7)) {
+			if (write_file(path, "online_movable"))
+				ret = -1;
+			else
+				n++;
+		}
+	}
+	closedir(dir);
+	printf("onlined %d memory blocks of node%d\n", n, node);
+
+	return ret;
+}
+
+static void *node_alloc(int node)
+{
+	unsigned long mask[16] = {};
+	void *buf;
+
+	if (node < 0 || node >= (int)(sizeof(mask) * 8))
+		return NULL;
+	buf = mmap(NULL, NODE_BUF, PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (buf == MAP_FAILED)
+		return NULL;
+	mask[node / (8 * sizeof(long))] = 1UL << (node % (8 * sizeof(long)));
+	if (syscall(SYS_mbind, buf, NODE_BUF, MPOL_BIND, mask,
+		    sizeof(mask) * 8, 0)) {
+		munmap(buf, NODE_BUF);
+		return NULL;
+	}
+	/* fault it in on the bound node */
+	memset(buf, node, NODE_BUF);
+
+	return buf;
+}
+
+static int node_bench(int node)
+{
+	static const char * const names[] = {
+		"ram->ram", "ram->node", "node->ram", "node->node",
+	};
+	unsigned long long t0, ns;
+	unsigned int cpu, ram;
+	void *bufs[4] = {}, *dst, *src;
+	int i, j, ret = 0;
+
+	if (node_online(node))
+		return -1;
+	if (syscall(SYS_getcpu, &cpu, &ram, NULL))
+		ram = 0;
+
+	for (i = 0; i < 4; i++) {
+		bufs[i] = node_alloc(i < 2 ? (int)ram : node);
+		if (!bufs[i]) {
+			fprintf(stderr, "node%d: no %lu byte buffer: %s\n",
+				i < 2 ? (int)ram : node, NODE_BUF, strerror(errno));
+			ret = -1;
+			goto out;
+		}
+	}
+
+	printf("RAM node%u, region node%d\n", ram, node);
+	printf("%-12s %12s %8s\n", "memcpy", "bytes", "MB/s");
+	for (i = 0; i < 4; i++) {
+		/* src is the first buffer of its node, dst the second */
+		src = bufs[i & 2 ? 2 : 0];
+		dst = bufs[i & 1 ? 3 : 1];
+		t0 = now_ns();
+		for (j = 0; j < NODE_LOOPS; j++)
+			memcpy(dst, src, NODE_BUF);
+		ns = now_ns() - t0;
+		printf("%-12s %12lu %8llu\n", names[i], NODE_BUF * NODE_LOOPS,
+		       ns ? NODE_BUF * NODE_LOOPS * 1000ULL / ns : 0);
+	}
+
+out:
+	for (i = 0; i < 4; i++)
+		if (bufs[i])
+			munmap(bufs[i], NODE_BUF);
+
+	return ret;
+}
+
+/*
+ * Load a text trace, one "size to|from gap_us" record per line, into the
+ * module's "trace" file as the little-endian records the replay test reads.
+ */
+static int load_trace(const char *dir, const char *path)
+{
+	unsigned char rec[12];
+	unsigned long size, gap;
+	char line[128], way[8], out[256];
+	FILE *in, *fp;
+	int i, nr = 0, ret = 0;
+
+	in = fopen(path, "r");
+	if (!in) {
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		return -1;
+	}
+	snprintf(out, sizeof(out), "%s/trace", dir);
+	fp = fopen(out, "w");
+	if (!fp) {
+		fprintf(stderr, "%s: %s\n", out, strerror(errno));
+		fclose(in);
+		return -1;
+	}
+
+	while (fgets(line, sizeof(line), in)) {
+		if (line[0] == '#' ||
+		    sscanf(line, "%lu %7s %lu", &size, way, &gap) != 3)
+			continue;
+		memset(rec, 0, sizeof(rec));
+		for (i = 0; i < 4; i++) {
+			rec[i] = size >> (8 * i);
+			rec[4 + i] = gap >> (8 * i);
+		}
+		rec[8] = !strcmp(way, "from") || !strcmp(way, "1");
+		if (fwrite(rec, sizeof(rec), 1, fp) != 1) {
+			ret = -1;
+			break;
+		}
+		nr++;
+	}
+	fclose(in);
+	if (fclose(fp) || ret) {
+		fprintf(stderr, "%s: write failed: %s\n", out, strerror(errno));
+		return -1;
+	}
+	printf("loaded %d trace records from %s\n", nr, path);
+
+	return 0;
+}
+
+static const struct scenario *find_scenario(const char *name)
+{
+	unsigned int i;
+
+	for (i = 0; i < NR_SCENARIOS; i++)
+		if (!strcmp(scenarios[i].name, name))
+			return &scenarios[i];
+
+	return NULL;
+}
+
+static void usage(const char *prog)
+{
+	unsigned int i;
+
+	fprintf(stderr,
+		"usage: %s [-d dir] [-s scenario,...] [-n loops] [-o out.json]\n"
+		"          [-b baseline.json] [-t tolerance%%] [-w seconds]\n"
+		"          [-m /dev/rmem-<device>] [-f /dev/rmem-<device>]\n"
+		"          [-r trace.txt] [-S /dev/rmem-<device>] [-N node]\n"
+		"  -d  debugfs directory of the device (default %s)\n"
+		"  -s  scenarios to run (default all):",
+		prog, DEFAULT_DEBUGFS);
+	for (i = 0; i < NR_SCENARIOS; i++)
+		fprintf(stderr, " %s", scenarios[i].name);
+	fprintf(stderr,
+		"\n  -n  test_loops for the run\n"
+		"  -o  write the results as JSON\n"
+		"  -b  compare against a JSON baseline, exit 1 on regression\n"
+		"  -t  allowed regression in percent (default 5)\n"
+		"  -w  follow the telemetry stream instead of running scenarios\n"
+		"  -m  benchmark 4k and huge mappings of the region instead\n"
+		"  -f  time fenced copies of -l bytes (default 4096) -n times\n"
+		"  -r  load a \"size to|from gap_us\" trace for the replay scenario\n"
+		"  -S  compare read/write, splice and sendfile into the region\n"
+		"  -N  online the rmem_node node and compare memcpy against RAM\n");
+}
+
+int main(int argc, char **argv)
+{
+	const struct scenario *run[NR_SCENARIOS];
+	const char *dir = DEFAULT_DEBUGFS;
+	const char *out = NULL, *baseline = NULL, *mdev = NULL, *fdev = NULL;
+	const char *trace = NULL, *sdev = NULL;
+	unsigned long long flen = 4096;
+	char *list = NULL, *name, *loops = NULL;
+	unsigned int i, nr_run = 0, tol = 5, watch = 0;
+	int opt, ret, node = -1;
+
+	while ((opt = getopt(argc, argv, "d:s:n:o:b:t:w:m:f:l:r:S:N:h")) != -1) {
+		switch (opt) {
+		case 'd':
+			dir = optarg;
+			break;
+		case 's':
+			list = optarg;
+			break;
+		case 'n':
+			loops = optarg;
+			break;
+		case 'o':
+			out = optarg;
+			break;
+		case 'b':
+			baseline = optarg;
+			break;
+		case 't':
+			tol = strtoul(optarg, NULL, 0);
+			if (tol > 100)
+				tol = 100;
+			break;
+		case 'w':
+			watch = strtoul(optarg, NULL, 0);
+			break;
+		case 'm':
+			mdev = optarg;
+			break;
+		case 'f':
+			fdev = optarg;
+			break;
+		case 'l':
+			flen = strtoull(optarg, NULL, 0);
+			break;
+		case 'r':
+			trace = optarg;
+			break;
+		case 'S':
+			sdev = optarg;
+			break;
+		case 'N':
+			node = strtol(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+			return 2;
+		}
+	}
+
+	if (watch)
+		return watch_stream(dir, watch) ? 2 : 0;
+	if (mdev)
+		return mmap_bench(mdev) ? 2 : 0;
+	if (fdev)
+		return fence_bench(fdev, flen,
+				   loops ? strtoul(loops, NULL, 0) : 100) ? 2 : 0;
+	if (sdev)
+		return splice_bench(sdev) ? 2 : 0;
+	if (node >= 0)
+		return node_bench(node) ? 2 : 0;
+
+	if (list) {
+		for (name = strtok(list, ","); name; name = strtok(NULL, ",")) {
+			if (nr_run == NR_SCENARIOS)
+				break;
+			run[nr_run] = find_scenario(name);
+			if (!run[nr_run]) {
+				fprintf(stderr, "unknown scenario: %s\n", name);
+				return 2;
+			}
+			nr_run++;
+		}
+	} else {
+		for (i = 0; i < NR_SCENARIOS; i++)
+			run[nr_run++] = &scenarios[i];
+	}
+
+	if (loops && write_file(PARAM_DIR "/test_loops", loops))
+		return 2;
+	if (trace && load_trace(dir, trace))
+		return 2;
+
+	for (i = 0; i < nr_run; i++)
+		if (run_scenario(dir, run[i]))
+			return 2;
+
+	print_table();
+
+	if (out && write_json(out))
+		return 2;
+
+	if (baseline) {
+		ret = compare_baseline(baseline, tol);
+		if (ret < 0)
+			return 2;
+		if (ret > 0)
+			return 1;
+	}
+
+	return 0;
+}
@@ -4,17 +4,102 @@
  * Author: Kunihiko Hayashi <hayashi.kunihiko@socionext.com>
  */
 
+#include <linux/async_tx.h>
+#include <linux/atomic.h>
+#include <linux/cache.h>
+#include <linux/completion.h>
 #include <linux/crc32.h>
+#include <linux/debugfs.h>
+#include <linux/delay.h>
 #include <linux/device.h>
 #include <linux/dmaengine.h>
+#include <linux/dma-fence.h>
 #include <linux/dma-mapping.h>
+#include <linux/file.h>
+#include <linux/firmware.h>
+#include <linux/fs.h>
+#include <linux/hrtimer.h>
+#include <linux/huge_mm.h>
 #include <linux/io.h>
+#include <linux/kernel.h>
+#include <linux/kref.h>
+#include <linux/kthread.h>
+#include <linux/ktime.h>
+#include <linux/list.h>
+#include <linux/log2.h>
+#include <linux/memory.h>
+#include <linux/memory_hotplug.h>
+#include <linux/miscdevice.h>
+#include <linux/mm.h>
 #include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/numa.h>
+#include <linux/of.h>
 #include <linux/of_device.h>
 #include <linux/of_reserved_mem.h>
+#include <linux/perf_event.h>
 #include <linux/platform_device.h>
+#include <linux/pm_runtime.h>
 #include <linux/random.h>
+#include <linux/relay.h>
+#include <linux/rwsem.h>
+#include <linux/scatterlist.h>
+#include <linux/sched.h>
+#include <linux/seq_file.h>
+#include <linux/sizes.h>
+#include <linux/slab.h>
+#include <linux/sort.h>
+#include <linux/spinlock.h>
+#include <linux/sync_file.h>
+#include <linux/sysfs.h>
+#include <linux/timex.h>
+#include <linux/topology.h>
+#include <linux/uaccess.h>
+#include <linux/uio.h>
 #include <linux/version.h>
+#include <linux/vmalloc.h>
+#include <linux/wait.h>
+#include <linux/workqueue.h>
+
+#define TEST_TYPE_DMA		BIT(0)
+#define TEST_TYPE_CPU		BIT(1)
+#define TEST_TYPE_SCHED		BIT(2)
+#define TEST_TYPE_NUMA		BIT(3)
+#define TEST_TYPE_SURVEY	BIT(4)
+#define TEST_TYPE_SLAVE		BIT(5)
+#define TEST_TYPE_TUNE		BIT(6)
+#define TEST_TYPE_FUSED		BIT(7)
+#define TEST_TYPE_SIZED		BIT(8)
+#define TEST_TYPE_TELEM		BIT(9)
+#define TEST_TYPE_RT		BIT(10)
+#define TEST_TYPE_SUBMIT	BIT(11)
+#define TEST_TYPE_PERCPU	BIT(12)
+#define TEST_TYPE_HUGE		BIT(13)
+#define TEST_TYPE_FENCE		BIT(14)
+#define TEST_TYPE_ASYNC		BIT(15)
+#define TEST_TYPE_PM		BIT(16)
+#define TEST_TYPE_REPLAY	BIT(17)
+#define TEST_TYPE_SAMPLE	BIT(18)
+#define TEST_TYPE_NODE		BIT(19)
+#define TEST_TYPE_HEAT		BIT(20)
+
+/* ioctl of /dev/rmem-<device>, mirrored in rmem_bench.c */
+#define TEST_IOC_TO_FIX		0	/* src -> fixmem */
+#define TEST_IOC_FROM_FIX	1	/* fixmem -> dst */
+
+struct test_ioc_copy {
+	__u32 dir;
+	__u32 flags;		/* must be 0 */
+	__u64 offset;
+	__u64 len;
+	__s32 fence_fd;		/* out: sync_file signalled on completion */
+	__u32 pad;
+};
+
+#define TEST_IOC_COPY		_IOWR('R', 0x01, struct test_ioc_copy)
+
+#define TEST_TUNE_MAX_CHANS	4
+#define TEST_TUNE_MAX_DEPTH	8
 
 static unsigned int test_buf_size = 16384;
 module_param(test_buf_size, uint, S_IRUGO | S_IWUSR);
@@ -22,22 +107,361 @@ MODULE_PARM_DESC(test_buf_size, "Size of the memcpy test buffer");
 
 static unsigned int test_type = 3;
 module_param(test_type, uint, S_IRUGO | S_IWUSR);
-MODULE_PARM_DESC(test_type, "Type of test (1=dma only, 2=cpu only, 3=both");
+MODULE_PARM_DESC(test_type, "Type of test (bitmask: 1=dma, 2=cpu, 4=sched, 8=numa, 16=survey, 32=slave, 64=tune, 128=fused, 256=sized, 512=telem, 1024=rt, 2048=submit, 4096=percpu, 8192=huge, 16384=fence, 32768=async, 65536=pm, 131072=replay, 262144=sample, 524288=node, 1048576=heat)");
+
+static unsigned int test_loops = 100;
+module_param(test_loops, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(test_loops, "Number of iterations of the benchmarks");
+
+static unsigned int scrub_budget;
+module_param(scrub_budget, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(scrub_budget, "Bandwidth budget of the scrubber in KiB/s (0=paused)");
+
+static unsigned int scrub_chunk_size = 4096;
+module_param(scrub_chunk_size, uint, S_IRUGO);
+MODULE_PARM_DESC(scrub_chunk_size, "Size of the chunk checksummed by the scrubber");
+
+static unsigned int sched_chunk = 4096;
+module_param(sched_chunk, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(sched_chunk, "Largest DMA issued at once by the copy scheduler");
+
+static unsigned int sched_bulk_rate = 64;
+module_param(sched_bulk_rate, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(sched_bulk_rate, "Bandwidth cap of the bulk class in MiB/s (0=uncapped)");
+
+static unsigned int sched_bulk_threads = 2;
+module_param(sched_bulk_threads, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(sched_bulk_threads, "Number of bulk clients in the sched test");
+
+static unsigned int sched_hp_size = 256;
+module_param(sched_hp_size, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(sched_hp_size, "Size of the high priority copy in the sched test");
+
+static bool chan_numa = true;
+module_param(chan_numa, bool, S_IRUGO);
+MODULE_PARM_DESC(chan_numa, "Prefer a DMA channel on the NUMA node of the buffers");
+
+static unsigned int slave_burst = 16;
+module_param(slave_burst, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(slave_burst, "Max burst of the slave dma in words");
+
+static unsigned int slave_sg_seg = 4096;
+module_param(slave_sg_seg, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(slave_sg_seg, "Segment size of the slave_sg transfer");
+
+static unsigned int tune_loops = 10;
+module_param(tune_loops, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(tune_loops, "Number of iterations per auto-tune candidate");
+
+static unsigned int tune_max_chans = 2;
+module_param(tune_max_chans, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(tune_max_chans, "Max number of DMA channels tried by the auto-tuner");
+
+static bool tune_persist = true;
+module_param(tune_persist, bool, S_IRUGO);
+MODULE_PARM_DESC(tune_persist, "Keep the auto-tune result in the reserved region");
+
+static bool tune_force;
+module_param(tune_force, bool, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(tune_force, "Auto-tune even if a saved calibration matches");
+
+static bool telemetry = true;
+module_param(telemetry, bool, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(telemetry, "Count bytes, ops, errors and latency of transfers");
+
+static unsigned int telem_interval_ms = 1000;
+module_param(telem_interval_ms, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(telem_interval_ms, "Interval of the telemetry stream in ms (0=off)");
+
+static bool timing_cycles;
+module_param(timing_cycles, bool, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(timing_cycles, "Time benchmarks with the cycle counter instead of ktime");
+
+static unsigned int rt_period_us = 250;
+module_param(rt_period_us, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(rt_period_us, "Period of the real-time copy loop in us");
+
+static unsigned int rt_size = 4096;
+module_param(rt_size, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(rt_size, "Bytes copied per period by the real-time loop");
+
+static unsigned int rt_loops = 4000;
+module_param(rt_loops, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(rt_loops, "Number of periods of the real-time loop");
+
+static unsigned int rt_load;
+module_param(rt_load, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(rt_load, "Background memory load threads during the real-time loop");
+
+static unsigned int submit_threads = 8;
+module_param(submit_threads, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(submit_threads, "Maximum number of concurrent submitters on one channel");
+
+static unsigned int percpu_threads;
+module_param(percpu_threads, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(percpu_threads, "Submitting CPUs of the per-CPU channel test (0=all online)");
+
+static unsigned int huge_loops = 4;
+module_param(huge_loops, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(huge_loops, "Scans of the reserved region per huge-mapping benchmark");
+
+static bool mmap_huge = true;
+module_param(mmap_huge, bool, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(mmap_huge, "Map the region to userspace with PMD/PUD block mappings");
+
+static unsigned long mmap_huge_maps;
+module_param(mmap_huge_maps, ulong, S_IRUGO);
+MODULE_PARM_DESC(mmap_huge_maps, "Block mappings inserted by userspace faults so far (read-only)");
+
+static unsigned int async_chain = 2;
+module_param(async_chain, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(async_chain, "Legs of the dependent copy chain (even, >= 2)");
+
+static unsigned int pm_gaps_ms[8] = { 1, 10, 100, 1000 };
+static unsigned int pm_nr_gaps = 4;
+module_param_array(pm_gaps_ms, uint, &pm_nr_gaps, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(pm_gaps_ms, "Idle gaps before each burst in ms (up to 8)");
+
+static unsigned int pm_bursts = 10;
+module_param(pm_bursts, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(pm_bursts, "Bursts per idle gap");
+
+static unsigned int pm_burst = 8;
+module_param(pm_burst, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(pm_burst, "Transfers per burst");
+
+static char *replay_fw;
+module_param(replay_fw, charp, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(replay_fw, "Firmware file with a trace to replay");
+
+static unsigned int replay_synth = 3;
+module_param(replay_synth, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(replay_synth, "Synthetic traces to replay (bitmask: 1=bimodal, 2=zipf)");
+
+static unsigned int replay_count = 1000;
+module_param(replay_count, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(replay_count, "Records of each synthetic trace");
+
+static unsigned int replay_gap_us = 50;
+module_param(replay_gap_us, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(replay_gap_us, "Mean inter-arrival time of synthetic traces in us");
+
+static bool replay_cpu;
+module_param(replay_cpu, bool, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(replay_cpu, "Replay on the CPU instead of the DMA channel");
+
+static bool splice_dma = true;
+module_param(splice_dma, bool, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(splice_dma, "Move spliced pages to and from the region by DMA");
+
+static unsigned int sample_pct = 5;
+module_param(sample_pct, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(sample_pct, "Percentage of cache lines checked per transfer by the sample test");
+
+static unsigned int sample_seed = 0x534d504c;
+module_param(sample_seed, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(sample_seed, "Seed of the lines the sample test picks at random");
+
+static int rmem_node = NUMA_NO_NODE;
+module_param(rmem_node, int, S_IRUGO);
+MODULE_PARM_DESC(rmem_node, "Hotplug the second memory-region as RAM of this node (-1: off)");
+
+static unsigned int heat_window = SZ_64K;
+module_param(heat_window, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(heat_window, "Window size the heat test walks the region with");
+
+static unsigned int heat_loops = 8;
+module_param(heat_loops, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(heat_loops, "Copies per window and access type in the heat test");
+
+static unsigned int heat_pct = 20;
+module_param(heat_pct, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(heat_pct, "Percent below the region average a window is flagged at");
 
 #if LINUX_VERSION_CODE < KERNEL_VERSION(5, 10, 0)
 #define dmaengine_get_dma_device(c) ((c)->device->dev)
+
+static inline int pm_runtime_resume_and_get(struct device *dev)
+{
+	int ret = pm_runtime_get_sync(dev);
+
+	if (ret < 0) {
+		pm_runtime_put_noidle(dev);
+		return ret;
+	}
+
+	return 0;
+}
 #endif
 
-static int test_memcpy_dma(struct dma_chan *chan,
-			   dma_addr_t dst, dma_addr_t src, size_t len)
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5, 9, 0)
+static void sched_set_fifo(struct task_struct *p)
+{
+	struct sched_param sp = { .sched_priority = MAX_RT_PRIO / 2 };
+
+	sched_setscheduler_nocheck(p, SCHED_FIFO, &sp);
+}
+#endif
+
+static const size_t test_tune_sizes[] = { SZ_256, SZ_4K, SZ_64K, SZ_1M };
+
+struct test_tune_cfg {
+	size_t size;
+	unsigned int depth;
+	unsigned int chunk;
+	unsigned int nr_chans;
+	unsigned int cpu_pct;
+	u64 ns;
+};
+
+#define TEST_CALIB_MAGIC	0x52434d54	/* "TMCR" */
+#define TEST_CALIB_VERSION	1
+
+struct test_calib_rec {
+	__le32 magic;
+	__le16 version;
+	__le16 nr_tune;
+	__le32 fingerprint;
+	__le32 crossover;
+	struct {
+		__le32 size;
+		__le32 depth;
+		__le32 chunk;
+		__le32 nr_chans;
+		__le32 cpu_pct;
+		__le64 ns;
+	} __packed tune[ARRAY_SIZE(test_tune_sizes)];
+	__le32 crc;
+} __packed;
+
+#define TEST_MAX_RESULTS	256
+
+struct test_result {
+	char name[32];
+	size_t size;
+	unsigned int n;
+	u64 min, avg, max;
+	u64 mbps;
+};
+
+enum test_engine {
+	TEST_ENG_CPU,
+	TEST_ENG_DMA,
+	TEST_ENG_NR,
+};
+
+enum test_dir {
+	TEST_DIR_TO_FIX,
+	TEST_DIR_FROM_FIX,
+	TEST_DIR_NR,
+};
+
+/* bucket 0 is < 1 us, bucket n is [2^(n+9), 2^(n+10)) ns, the last is open */
+#define TEST_TELEM_BUCKETS	16
+
+struct test_telem_ctr {
+	u64 bytes;
+	u64 ops;
+	u64 errors;
+	u64 lat[TEST_TELEM_BUCKETS];
+};
+
+struct test_telem {
+	struct test_telem_ctr ctr[TEST_ENG_NR][TEST_DIR_NR];
+};
+
+struct test_rmem_priv {
+	struct device *dev;
+	struct dma_chan *chan;
+	struct device *chan_dev;
+	struct dma_chan *slave_chan;
+	bool chan_slave;
+	void *src_addr, *fixmem_addr, *dst_addr;
+	dma_addr_t fixmem_paddr;
+	phys_addr_t fixmem_phys;
+	unsigned long attrs;
+	size_t len;
+	int node;
+
+	/* serializes the tests and the scrubber on fixmem */
+	struct mutex lock;
+
+	struct task_struct *scrub_task;
+	size_t scrub_chunk;
+	unsigned int scrub_nr_chunks;
+	u32 *scrub_crc;
+	unsigned long *scrub_valid;
+	atomic64_t scrub_bytes;
+	atomic64_t scrub_mismatches;
+	atomic64_t scrub_passes;
+	unsigned int scrub_map_gen;
+
+	struct test_tune_cfg tune[ARRAY_SIZE(test_tune_sizes)];
+	unsigned int nr_tune;
+	unsigned int crossover;
+
+	struct reserved_mem *rmem;
+	struct reserved_mem *node_rmem;
+	const char *node_res;
+	int node_nid;
+	struct test_calib_rec *calib;
+	dma_addr_t calib_paddr;
+	bool calib_loaded;
+
+	struct test_telem __percpu *telem;
+	struct rchan *stream;
+	struct delayed_work stream_work;
+	struct test_telem stream_prev;
+	u64 stream_last_ns;
+	u64 stream_seq;
+
+	bool time_cycles;
+	u32 time_mult;
+	u64 time_overhead_ns;
+
+	struct test_mmap_dev *mmap_dev;
+	void *region_addr;
+	dma_addr_t region_dma;
+
+	spinlock_t fence_lock;
+	struct list_head fence_jobs;
+	wait_queue_head_t fence_wq;
+	atomic_t fence_inflight;
+	u64 fence_ctx;
+	u64 fence_seqno;
+
+	u8 *trace;
+	size_t trace_bytes;
+
+	struct dentry *debugfs;
+	struct test_result results[TEST_MAX_RESULTS];
+	unsigned int nr_results;
+};
+
+/* /dev/rmem-<device>, described with its file operations below */
+struct test_mmap_dev {
+	struct miscdevice mdev;
+	struct kref ref;
+	struct rw_semaphore sem;
+	struct test_rmem_priv *priv;
+	struct reserved_mem *rmem;
+	atomic_t writers;	/* writable mappings */
+	atomic_t map_gen;	/* bumped as they come and go */
+};
+
+struct test_chan_map {
+	struct dma_chan *chan;
+	struct device *dev;
+	dma_addr_t src, fix, dst;
+};
+
+static int test_dma_wait(struct dma_chan *chan,
+			 struct dma_async_tx_descriptor *tx)
 {
 	struct device *dev = dmaengine_get_dma_device(chan);
-	struct dma_async_tx_descriptor *tx;
 	dma_cookie_t cookie;
 	enum dma_status status;
-	enum dma_ctrl_flags flags = DMA_PREP_INTERRUPT | DMA_CTRL_ACK;
 
-	tx = dmaengine_prep_dma_memcpy(chan, dst, src, len, flags);
 	if (!tx) {
 		dev_err(dev, "Failed to prepare dma\n");
 		return -ENODEV;
@@ -60,6 +484,91 @@ static int test_memcpy_dma(struct dma_chan *chan,
 	return 0;
 }
 
+static int test_memcpy_dma(struct dma_chan *chan,
+			   dma_addr_t dst, dma_addr_t src, size_t len)
+{
+	enum dma_ctrl_flags flags = DMA_PREP_INTERRUPT | DMA_CTRL_ACK;
+
+	return test_dma_wait(chan, dmaengine_prep_dma_memcpy(chan, dst, src,
+							     len, flags));
+}
+
+/*
+ * Slave DMA path for engines that reach fixmem only as a peripheral.
+ * fixmem is programmed as the device address, so the engine has to
+ * increment it like a memory address.
+ */
+static int test_slave_dma(struct dma_chan *chan, enum dma_transfer_direction dir,
+			  dma_addr_t buf, dma_addr_t fix, size_t len)
+{
+	struct dma_slave_config cfg = {
+		.direction = dir,
+		.src_addr_width = DMA_SLAVE_BUSWIDTH_4_BYTES,
+		.dst_addr_width = DMA_SLAVE_BUSWIDTH_4_BYTES,
+		.src_maxburst = slave_burst,
+		.dst_maxburst = slave_burst,
+	};
+	enum dma_ctrl_flags flags = DMA_PREP_INTERRUPT | DMA_CTRL_ACK;
+	int ret;
+
+	if (dir == DMA_MEM_TO_DEV)
+		cfg.dst_addr = fix;
+	else
+		cfg.src_addr = fix;
+
+	ret = dmaengine_slave_config(chan, &cfg);
+	if (ret)
+		return ret;
+
+	return test_dma_wait(chan, dmaengine_prep_slave_single(chan, buf, len,
+							       dir, flags));
+}
+
+static int test_slave_sg_dma(struct dma_chan *chan, enum dma_transfer_direction dir,
+			     dma_addr_t buf, dma_addr_t fix, size_t len)
+{
+	struct dma_slave_config cfg = {
+		.direction = dir,
+		.src_addr_width = DMA_SLAVE_BUSWIDTH_4_BYTES,
+		.dst_addr_width = DMA_SLAVE_BUSWIDTH_4_BYTES,
+		.src_maxburst = slave_burst,
+		.dst_maxburst = slave_burst,
+	};
+	enum dma_ctrl_flags flags = DMA_PREP_INTERRUPT | DMA_CTRL_ACK;
+	size_t seg = clamp_t(size_t, slave_sg_seg, 4, len);
+	struct scatterlist *sg;
+	struct sg_table sgt;
+	size_t off = 0;
+	int i, ret;
+
+	if (dir == DMA_MEM_TO_DEV)
+		cfg.dst_addr = fix;
+	else
+		cfg.src_addr = fix;
+
+	ret = dmaengine_slave_config(chan, &cfg);
+	if (ret)
+		return ret;
+
+	ret = sg_alloc_table(&sgt, DIV_ROUND_UP(len, seg), GFP_KERNEL);
+	if (ret)
+		return ret;
+
+	/* buf is already mapped, only the DMA side of the list is used */
+	for_each_sg(sgt.sgl, sg, sgt.orig_nents, i) {
+		sg_dma_address(sg) = buf + off;
+		sg_dma_len(sg) = min(seg, len - off);
+		off += seg;
+	}
+
+	ret = test_dma_wait(chan, dmaengine_prep_slave_sg(chan, sgt.sgl,
+							  sgt.orig_nents,
+							  dir, flags));
+	sg_free_table(&sgt);
+
+	return ret;
+}
+
 static void test_memory_init(u32 *src, u32 *fix, u32 *dst, int len)
 {
 	int i;
@@ -71,71 +580,373 @@ static void test_memory_init(u32 *src, u32 *fix, u32 *dst, int len)
 	}
 }
 
-static int test_rmem_trasnfer_probe(struct platform_device *pdev)
+/*
+ * Background scrubber: walks fixmem in chunks at a low priority and
+ * compares each chunk against its last known checksum. Chunks written by
+ * the tests are invalidated and only re-baselined on the next visit.
+ * Userspace writes through /dev/rmem-<device> mappings can't be tracked,
+ * so while any mapping is writable, and once after the last goes away,
+ * everything is invalidated instead.
+ */
+static void test_scrub_invalidate(struct test_rmem_priv *priv,
+				  size_t off, size_t len)
 {
-	struct device *dev = &pdev->dev;
-	struct device *chan_dev;
-	struct dma_chan *chan;
-	void *src_addr, *fixmem_addr, *dst_addr;
-	dma_addr_t src_paddr, fixmem_paddr, dst_paddr;
-	dma_cap_mask_t mask;
-	unsigned long attrs;
-	size_t len = test_buf_size;
-	u32 crc1, crc2;
-	int ret = 0;
+	unsigned int first, last;
 
-	dev_info(dev, "transfer test for reserved-memory\n");
+	if (!priv->scrub_valid || !len)
+		return;
 
-	/* Request DMA channel */
-	dma_cap_zero(mask);
-	dma_cap_set(DMA_MEMCPY, mask);
-	chan = dma_request_channel(mask, NULL, NULL);
-	if (!chan) {
-		dev_err(dev, "Failed to request dma channel\n");
-		return -EPROBE_DEFER;
+	first = off / priv->scrub_chunk;
+	last = (off + len - 1) / priv->scrub_chunk;
+	bitmap_clear(priv->scrub_valid, first, last - first + 1);
+}
+
+/* called with priv->lock held, which test_mmap_exit() takes to clear md */
+static void test_scrub_mapped(struct test_rmem_priv *priv)
+{
+	struct test_mmap_dev *md = priv->mmap_dev;
+	unsigned int gen;
+
+	if (!md)
+		return;
+
+	gen = atomic_read(&md->map_gen);
+	if (!atomic_read(&md->writers) && gen == priv->scrub_map_gen)
+		return;
+
+	bitmap_zero(priv->scrub_valid, priv->scrub_nr_chunks);
+	priv->scrub_map_gen = gen;
+}
+
+static void test_scrub_chunk(struct test_rmem_priv *priv, unsigned int i)
+{
+	size_t off = (size_t)i * priv->scrub_chunk;
+	size_t len = min(priv->scrub_chunk, priv->len - off);
+	u32 crc;
+
+	crc = crc32_le(0, priv->fixmem_addr + off, len);
+	atomic64_add(len, &priv->scrub_bytes);
+
+	if (!test_bit(i, priv->scrub_valid)) {
+		priv->scrub_crc[i] = crc;
+		set_bit(i, priv->scrub_valid);
+		return;
 	}
-	chan_dev = dmaengine_get_dma_device(chan);
 
-	/* Fixed memory */
-	ret = of_reserved_mem_device_init_by_idx(chan_dev, dev->of_node, 0);
-	if (ret) {
-		dev_err(dev, "No memory-region found for index 0\n");
-		goto out_release_chan;
+	if (crc != priv->scrub_crc[i]) {
+		atomic64_inc(&priv->scrub_mismatches);
+		dev_warn_ratelimited(priv->dev,
+				     "SCRUB: fix:%zx+%zx crc %08x != %08x\n",
+				     off, len, crc, priv->scrub_crc[i]);
+		priv->scrub_crc[i] = crc;
 	}
+}
 
-	src_addr = devm_kmalloc(dev, len, GFP_KERNEL);
-	if (!src_addr) {
-		ret = -ENOMEM;
-		goto out_unreg_fixmem;
+static int test_scrub_thread(void *data)
+{
+	struct test_rmem_priv *priv = data;
+	u64 debt_ns = 0, msecs;
+	u32 rem_ns;
+	unsigned int i = 0;
+	unsigned int budget;
+
+	set_user_nice(current, MAX_NICE);
+
+	while (!kthread_should_stop()) {
+		budget = READ_ONCE(scrub_budget);
+		if (!budget) {
+			/* kthread_stop() wakes us, unlike msleep */
+			schedule_timeout_interruptible(HZ);
+			continue;
+		}
+
+		mutex_lock(&priv->lock);
+		/* fenced copies may still be writing fixmem */
+		if (atomic_read(&priv->fence_inflight)) {
+			mutex_unlock(&priv->lock);
+			schedule_timeout_interruptible(1);
+			continue;
+		}
+		test_scrub_mapped(priv);
+		test_scrub_chunk(priv, i);
+		mutex_unlock(&priv->lock);
+
+		if (++i == priv->scrub_nr_chunks) {
+			atomic64_inc(&priv->scrub_passes);
+			i = 0;
+		}
+
+		/* sleep off the time this chunk costs against the budget */
+		debt_ns += div64_u64((u64)priv->scrub_chunk * NSEC_PER_SEC,
+				     (u64)budget * 1024);
+		if (debt_ns >= NSEC_PER_MSEC) {
+			msecs = div_u64_rem(debt_ns, NSEC_PER_MSEC, &rem_ns);
+			schedule_timeout_interruptible(msecs_to_jiffies(msecs));
+			debt_ns = rem_ns;
+		} else {
+			cond_resched();
+		}
 	}
 
-	dst_addr = devm_kmalloc(dev, len, GFP_KERNEL);
-	if (!dst_addr) {
-		ret = -ENOMEM;
-		goto out_free_src;
+	return 0;
+}
+
+static int test_scrub_start(struct test_rmem_priv *priv)
+{
+	struct device *dev = priv->dev;
+
+	priv->scrub_chunk = clamp_t(size_t, scrub_chunk_size, 64, priv->len);
+	priv->scrub_nr_chunks = DIV_ROUND_UP(priv->len, priv->scrub_chunk);
+
+	priv->scrub_crc = devm_kcalloc(dev, priv->scrub_nr_chunks,
+				       sizeof(*priv->scrub_crc), GFP_KERNEL);
+	priv->scrub_valid = devm_kcalloc(dev, BITS_TO_LONGS(priv->scrub_nr_chunks),
+					 sizeof(long), GFP_KERNEL);
+	if (!priv->scrub_crc || !priv->scrub_valid)
+		return -ENOMEM;
+
+	priv->scrub_task = kthread_run(test_scrub_thread, priv, "rmem-scrub/%s",
+				       dev_name(dev));
+	if (IS_ERR(priv->scrub_task)) {
+		dev_err(dev, "Failed to start scrubber\n");
+		return PTR_ERR(priv->scrub_task);
 	}
 
-	attrs = DMA_ATTR_FORCE_CONTIGUOUS;
-	fixmem_addr = dma_alloc_attrs(chan_dev, len, &fixmem_paddr, GFP_KERNEL, attrs);
-	if (!fixmem_addr) {
-		ret = -ENOMEM;
-		goto out_free_dst;
+	return 0;
+}
+
+static void test_scrub_stop(struct test_rmem_priv *priv)
+{
+	kthread_stop(priv->scrub_task);
+}
+
+/*
+ * Per-CPU telemetry: the transfer paths bump counters of their own CPU
+ * without locking, and readers sum over all CPUs.
+ */
+static unsigned int test_telem_bucket(u64 ns)
+{
+	if (ns < 1024)
+		return 0;
+
+	return min_t(unsigned int, ilog2(ns) - 9, TEST_TELEM_BUCKETS - 1);
+}
+
+static void test_telem_account(struct test_rmem_priv *priv,
+			       enum test_engine eng, enum test_dir dir,
+			       size_t bytes, u64 ns, int err)
+{
+	struct test_telem_ctr __percpu *ctr;
+
+	if (!READ_ONCE(telemetry))
+		return;
+
+	ctr = &priv->telem->ctr[eng][dir];
+	if (err) {
+		this_cpu_inc(ctr->errors);
+		return;
+	}
+	this_cpu_add(ctr->bytes, bytes);
+	this_cpu_inc(ctr->ops);
+	this_cpu_inc(ctr->lat[test_telem_bucket(ns)]);
+}
+
+static void test_telem_sum(struct test_rmem_priv *priv, struct test_telem *sum)
+{
+	struct test_telem_ctr *src, *dst;
+	int cpu, e, d, b;
+
+	memset(sum, 0, sizeof(*sum));
+	for_each_possible_cpu(cpu) {
+		for (e = 0; e < TEST_ENG_NR; e++) {
+			for (d = 0; d < TEST_DIR_NR; d++) {
+				src = &per_cpu_ptr(priv->telem, cpu)->ctr[e][d];
+				dst = &sum->ctr[e][d];
+				dst->bytes += READ_ONCE(src->bytes);
+				dst->ops += READ_ONCE(src->ops);
+				dst->errors += READ_ONCE(src->errors);
+				for (b = 0; b < TEST_TELEM_BUCKETS; b++)
+					dst->lat[b] += READ_ONCE(src->lat[b]);
+			}
+		}
+	}
+}
+
+/*
+ * Time-series stream of the telemetry counters.  A delayed work emits one
+ * fixed-size sample per interval into a relay channel in debugfs, which
+ * userspace maps and polls.  The ring overwrites the oldest sub-buffer, and
+ * each sub-buffer is cleared when it is (re)entered, so a zero seq marks an
+ * empty slot.
+ */
+#define TEST_STREAM_SUBBUF	4096
+#define TEST_STREAM_NR_SUBBUF	16
+
+struct test_telem_sample {
+	u64 seq;
+	u64 ts_ns;
+	u64 interval_ns;
+	u64 bytes;
+	u64 ops;
+	u64 errors;
+	u64 p50_ns;		/* upper bound of the histogram bucket */
+	u64 p99_ns;
+};
+
+static u64 test_telem_pct(const u64 *lat, u64 total, unsigned int pct)
+{
+	u64 want = div_u64(total * pct + 99, 100), acc = 0;
+	int b;
+
+	for (b = 0; b < TEST_TELEM_BUCKETS; b++) {
+		acc += lat[b];
+		if (acc >= want)
+			break;
+	}
+
+	return 1ULL << (min(b, TEST_TELEM_BUCKETS - 1) + 10);
+}
+
+static void test_stream_work(struct work_struct *work)
+{
+	struct test_rmem_priv *priv = container_of(to_delayed_work(work),
+						   struct test_rmem_priv,
+						   stream_work);
+	struct test_telem_ctr *cur, *prev;
+	struct test_telem_sample smp = {};
+	u64 lat[TEST_TELEM_BUCKETS] = {};
+	struct test_telem *sum;
+	unsigned int interval;
+	int e, d, b;
+	u64 now;
+
+	sum = kmalloc(sizeof(*sum), GFP_KERNEL);
+	if (!sum)
+		goto out;
+
+	test_telem_sum(priv, sum);
+	now = ktime_get_ns();
+	for (e = 0; e < TEST_ENG_NR; e++) {
+		for (d = 0; d < TEST_DIR_NR; d++) {
+			cur = &sum->ctr[e][d];
+			prev = &priv->stream_prev.ctr[e][d];
+			smp.bytes += cur->bytes - prev->bytes;
+			smp.ops += cur->ops - prev->ops;
+			smp.errors += cur->errors - prev->errors;
+			for (b = 0; b < TEST_TELEM_BUCKETS; b++)
+				lat[b] += cur->lat[b] - prev->lat[b];
+		}
+	}
+
+	smp.seq = ++priv->stream_seq;
+	smp.ts_ns = now;
+	smp.interval_ns = now - priv->stream_last_ns;
+	if (smp.ops) {
+		smp.p50_ns = test_telem_pct(lat, smp.ops, 50);
+		smp.p99_ns = test_telem_pct(lat, smp.ops, 99);
+	}
+	relay_write(priv->stream, &smp, sizeof(smp));
+
+	priv->stream_prev = *sum;
+	priv->stream_last_ns = now;
+	kfree(sum);
+out:
+	interval = READ_ONCE(telem_interval_ms);
+	if (interval)
+		schedule_delayed_work(&priv->stream_work,
+				      msecs_to_jiffies(interval));
+}
+
+static int test_stream_subbuf_start(struct rchan_buf *buf, void *subbuf,
+				    void *prev_subbuf, size_t prev_padding)
+{
+	memset(subbuf, 0, buf->chan->subbuf_size);
+
+	return 1;
+}
+
+static struct dentry *test_stream_create_file(const char *filename,
+					      struct dentry *parent,
+					      umode_t mode,
+					      struct rchan_buf *buf,
+					      int *is_global)
+{
+	*is_global = 1;
+
+	return debugfs_create_file(filename, mode, parent, buf,
+				   &relay_file_operations);
+}
+
+static int test_stream_remove_file(struct dentry *dentry)
+{
+	debugfs_remove(dentry);
+
+	return 0;
+}
+
+static const struct rchan_callbacks test_stream_cb = {
+	.subbuf_start = test_stream_subbuf_start,
+	.create_buf_file = test_stream_create_file,
+	.remove_buf_file = test_stream_remove_file,
+};
+
+static void test_stream_start(struct test_rmem_priv *priv)
+{
+	unsigned int interval = READ_ONCE(telem_interval_ms);
+
+	INIT_DELAYED_WORK(&priv->stream_work, test_stream_work);
+	if (!interval)
+		return;
+
+	/* one global buffer, shows up as "stream0" */
+	priv->stream = relay_open("stream", priv->debugfs, TEST_STREAM_SUBBUF,
+				  TEST_STREAM_NR_SUBBUF, &test_stream_cb, NULL);
+	if (!priv->stream) {
+		dev_warn(priv->dev, "failed to open telemetry stream\n");
+		return;
 	}
 
-	if (!(test_type & 1))
-		goto test_dma_exit;
+	test_telem_sum(priv, &priv->stream_prev);
+	priv->stream_last_ns = ktime_get_ns();
+	schedule_delayed_work(&priv->stream_work, msecs_to_jiffies(interval));
+}
+
+static void test_stream_stop(struct test_rmem_priv *priv)
+{
+	if (!priv->stream)
+		return;
+
+	cancel_delayed_work_sync(&priv->stream_work);
+	relay_close(priv->stream);
+	priv->stream = NULL;
+}
+
+static int test_rmem_dma(struct test_rmem_priv *priv)
+{
+	struct device *dev = priv->dev;
+	struct device *chan_dev = priv->chan_dev;
+	void *src_addr = priv->src_addr;
+	void *fixmem_addr = priv->fixmem_addr;
+	void *dst_addr = priv->dst_addr;
+	dma_addr_t fixmem_paddr = priv->fixmem_paddr;
+	dma_addr_t src_paddr, dst_paddr;
+	size_t len = priv->len;
+	u32 crc1, crc2;
+	u64 t0;
+	int ret;
 
 	/* init for test DMA */
 	test_memory_init(src_addr, fixmem_addr, dst_addr, len);
 
 	src_paddr = dma_map_single(chan_dev, src_addr, len, DMA_TO_DEVICE);
-	ret = dma_mapping_error(dev, src_paddr);
+	ret = dma_mapping_error(chan_dev, src_paddr);
 	if (ret) {
 		dev_err(dev, "Failed to map src (%d)\n", ret);
-		goto test_dma_exit;
+		return ret;
 	}
 
 	dst_paddr = dma_map_single(chan_dev, dst_addr, len, DMA_FROM_DEVICE);
+	ret = dma_mapping_error(chan_dev, dst_paddr);
 	if (ret) {
 		dev_err(dev, "Failed to map dst (%d)\n", ret);
 		goto test_unmap_src;
@@ -143,7 +954,14 @@ static int test_rmem_trasnfer_probe(struct platform_device *pdev)
 
 	/* test DMA src->fix */
 	dma_sync_single_for_device(chan_dev, src_paddr, len, DMA_TO_DEVICE);
-	ret = test_memcpy_dma(chan, fixmem_paddr, src_paddr, len);
+	t0 = ktime_get_ns();
+	if (priv->chan_slave)
+		ret = test_slave_dma(priv->chan, DMA_MEM_TO_DEV, src_paddr,
+				     fixmem_paddr, len);
+	else
+		ret = test_memcpy_dma(priv->chan, fixmem_paddr, src_paddr, len);
+	test_telem_account(priv, TEST_ENG_DMA, TEST_DIR_TO_FIX, len,
+			   ktime_get_ns() - t0, ret);
 	dma_sync_single_for_cpu(chan_dev, src_paddr, len, DMA_TO_DEVICE);
 	if (ret) {
 		dev_err(dev, "Failed to transfer src->fix\n");
@@ -156,7 +974,14 @@ static int test_rmem_trasnfer_probe(struct platform_device *pdev)
 
 	/* test DMA fix->dst */
 	dma_sync_single_for_device(chan_dev, dst_paddr, len, DMA_FROM_DEVICE);
-	ret = test_memcpy_dma(chan, dst_paddr, fixmem_paddr, len);
+	t0 = ktime_get_ns();
+	if (priv->chan_slave)
+		ret = test_slave_dma(priv->chan, DMA_DEV_TO_MEM, dst_paddr,
+				     fixmem_paddr, len);
+	else
+		ret = test_memcpy_dma(priv->chan, dst_paddr, fixmem_paddr, len);
+	test_telem_account(priv, TEST_ENG_DMA, TEST_DIR_FROM_FIX, len,
+			   ktime_get_ns() - t0, ret);
 	dma_sync_single_for_cpu(chan_dev, dst_paddr, len, DMA_FROM_DEVICE);
 	if (ret) {
 		dev_err(dev, "Failed to transfer fix->dst\n");
@@ -171,42 +996,4557 @@ static int test_rmem_trasnfer_probe(struct platform_device *pdev)
 	dma_unmap_single(chan_dev, dst_paddr, len, DMA_FROM_DEVICE);
  test_unmap_src:
 	dma_unmap_single(chan_dev, src_paddr, len, DMA_TO_DEVICE);
- test_dma_exit:
 
-	if (!(test_type & 2))
-		goto test_cpu_exit;
+	return ret;
+}
 
-	/* init for test CPU */
+static int test_rmem_cpu(struct test_rmem_priv *priv)
+{
+	struct device *dev = priv->dev;
+	void *src_addr = priv->src_addr;
+	void *fixmem_addr = priv->fixmem_addr;
+	void *dst_addr = priv->dst_addr;
+	size_t len = priv->len;
+	u32 crc1, crc2;
+	u64 t0;
+
+	/* init for test CPU */
 	test_memory_init(src_addr, fixmem_addr, dst_addr, len);
 
 	/* test CPU src->fix */
+	t0 = ktime_get_ns();
 	memcpy(fixmem_addr, src_addr, len);
+	test_telem_account(priv, TEST_ENG_CPU, TEST_DIR_TO_FIX, len,
+			   ktime_get_ns() - t0, 0);
 	crc1 = crc32_le(0, src_addr, len);
 	crc2 = crc32_le(0, fixmem_addr, len);
 	dev_info(dev, "CPU: src:%px -> fix:%px %s\n", src_addr, fixmem_addr,
 		 (crc1 == crc2) ? "OK" : "NG");
 
 	/* test CPU fix->dst */
+	t0 = ktime_get_ns();
 	memcpy(dst_addr, fixmem_addr, len);
+	test_telem_account(priv, TEST_ENG_CPU, TEST_DIR_FROM_FIX, len,
+			   ktime_get_ns() - t0, 0);
 	crc1 = crc32_le(0, fixmem_addr, len);
 	crc2 = crc32_le(0, dst_addr, len);
 	dev_info(dev, "CPU: fix:%px -> dst:%px %s\n", fixmem_addr, dst_addr,
 		 (crc1 == crc2) ? "OK" : "NG");
 
-test_cpu_exit:
-	dma_free_attrs(chan_dev, len, fixmem_addr, fixmem_paddr, attrs);
-out_free_dst:
-	devm_kfree(dev, dst_addr);
-out_free_src:
-	devm_kfree(dev, src_addr);
-out_unreg_fixmem:
-	of_reserved_mem_device_release(chan_dev);
-out_release_chan:
-	dma_release_channel(chan);
+	return 0;
+}
+
+struct test_stat {
+	u64 min, max, sum;
+	unsigned int n;
+};
+
+static void test_stat_init(struct test_stat *st)
+{
+	st->min = U64_MAX;
+	st->max = 0;
+	st->sum = 0;
+	st->n = 0;
+}
+
+static void test_stat_add(struct test_stat *st, u64 ns)
+{
+	st->min = min(st->min, ns);
+	st->max = max(st->max, ns);
+	st->sum += ns;
+	st->n++;
+}
+
+static void test_stat_merge(struct test_stat *st, const struct test_stat *o)
+{
+	st->min = min(st->min, o->min);
+	st->max = max(st->max, o->max);
+	st->sum += o->sum;
+	st->n += o->n;
+}
+
+static void test_result_add(struct test_rmem_priv *priv, const char *name,
+			    size_t size, struct test_stat *st)
+{
+	struct test_result *res;
+
+	if (priv->nr_results == TEST_MAX_RESULTS || !st->n)
+		return;
+
+	res = &priv->results[priv->nr_results++];
+	strscpy(res->name, name, sizeof(res->name));
+	res->size = size;
+	res->n = st->n;
+	res->min = st->min;
+	res->avg = div_u64(st->sum, st->n);
+	res->max = st->max;
+	res->mbps = st->sum ? div64_u64((u64)size * st->n * 1000, st->sum) : 0;
+}
+
+static void test_stat_report(struct test_rmem_priv *priv, const char *name,
+			     size_t size, struct test_stat *st)
+{
+	u64 avg, mbps;
+
+	if (!st->n) {
+		dev_info(priv->dev, "%s: %zu bytes no samples\n", name, size);
+		return;
+	}
+
+	avg = div_u64(st->sum, st->n);
+	mbps = st->sum ? div64_u64((u64)size * st->n * 1000, st->sum) : 0;
+	dev_info(priv->dev, "%s: %zu bytes x%u min/avg/max %llu/%llu/%llu ns %llu MB/s\n",
+		 name, size, st->n, st->min, avg, st->max, mbps);
+	test_result_add(priv, name, size, st);
+}
+
+/*
+ * Timing layer for the benchmarks.  Timestamps are raw clock units, either
+ * ktime ns or the architecture cycle counter when timing_cycles is set,
+ * and are converted to ns with the cost of one clock read taken off.
+ * Copies up to TEST_TIME_BATCH_MAX bytes are repeated TEST_TIME_BATCH times
+ * per sample, so a clock read is not the same order as the copy.
+ */
+#define TEST_TIME_BATCH_MAX	SZ_1K
+#define TEST_TIME_BATCH		32
+#define TEST_TIME_CALIB_LOOPS	1000
+#define TEST_TIME_CALIB_MS	10
+#define TEST_TIME_SHIFT		20
+
+static inline u64 test_time_now(struct test_rmem_priv *priv)
+{
+	return priv->time_cycles ? (u64)get_cycles() : ktime_get_ns();
+}
+
+static u64 test_time_ns(struct test_rmem_priv *priv, u64 raw)
+{
+	if (priv->time_cycles)
+		return (raw * priv->time_mult) >> TEST_TIME_SHIFT;
+
+	return raw;
+}
+
+static unsigned int test_time_batch(size_t len)
+{
+	return len <= TEST_TIME_BATCH_MAX ? TEST_TIME_BATCH : 1;
+}
+
+/* account a batch of nr operations started at t0 as nr equal samples */
+static void test_time_add(struct test_rmem_priv *priv, struct test_stat *st,
+			  u64 t0, unsigned int nr)
+{
+	u64 ns = test_time_ns(priv, test_time_now(priv) - t0);
+
+	ns = ns > priv->time_overhead_ns ? ns - priv->time_overhead_ns : 0;
+	test_stat_add(st, div_u64(ns, nr));
+}
+
+static void test_time_calibrate(struct test_rmem_priv *priv)
+{
+	u64 c0, c1, n0, n1, t0, raw = U64_MAX;
+	unsigned int i;
+
+	priv->time_cycles = false;
+	if (READ_ONCE(timing_cycles)) {
+		/* cycles per ns over a short busy wait */
+		n0 = ktime_get_ns();
+		c0 = get_cycles();
+		mdelay(TEST_TIME_CALIB_MS);
+		c1 = get_cycles();
+		n1 = ktime_get_ns();
+		if (c1 > c0) {
+			priv->time_mult = div64_u64((n1 - n0) << TEST_TIME_SHIFT,
+						    c1 - c0);
+			priv->time_cycles = priv->time_mult != 0;
+		}
+		if (!priv->time_cycles)
+			dev_warn(priv->dev, "no usable cycle counter, using ktime\n");
+	}
+
+	/* the cheapest back-to-back read is the cost of one clock read */
+	for (i = 0; i < TEST_TIME_CALIB_LOOPS; i++) {
+		t0 = test_time_now(priv);
+		raw = min(raw, test_time_now(priv) - t0);
+	}
+	priv->time_overhead_ns = test_time_ns(priv, raw);
+
+	dev_info(priv->dev, "TIME: %s clock, read overhead %llu ns\n",
+		 priv->time_cycles ? "cycle" : "ktime", priv->time_overhead_ns);
+}
+
+/*
+ * Copy scheduler: clients queue DMA requests by priority class and the
+ * dispatcher issues them in chunks of at most sched_chunk bytes, highest
+ * class first, subject to each client's token bucket.
+ */
+enum test_sched_prio {
+	TEST_SCHED_HIGH,
+	TEST_SCHED_NORMAL,
+	TEST_SCHED_BULK,
+	TEST_SCHED_NR_PRIO,
+};
+
+struct test_sched_client {
+	enum test_sched_prio prio;
+	u64 rate;	/* bytes per second, 0 = uncapped */
+	u64 burst;	/* bucket depth in bytes */
+	u64 tokens;
+	u64 last_ns;
+};
+
+struct test_sched_req {
+	struct list_head node;
+	struct test_sched_client *client;
+	dma_addr_t dst, src;
+	size_t len, done;
+	int ret;
+	struct completion cmp;
+};
+
+struct test_sched {
+	struct test_rmem_priv *priv;
+	struct dma_chan *chan;
+	size_t chunk;
+	spinlock_t lock;
+	struct list_head queue[TEST_SCHED_NR_PRIO];
+	unsigned long seq;
+	wait_queue_head_t wq;
+	struct task_struct *task;
+};
+
+static void test_sched_client_init(struct test_sched *s,
+				   struct test_sched_client *c,
+				   enum test_sched_prio prio, u64 rate)
+{
+	c->prio = prio;
+	c->rate = rate;
+	c->burst = max_t(u64, s->chunk, div_u64(rate, 10));
+	c->tokens = c->burst;
+	c->last_ns = ktime_get_ns();
+}
+
+static bool test_sched_admit(struct test_sched_client *c, size_t len,
+			     u64 now, u64 *wait_ns)
+{
+	u64 need;
+
+	if (!c->rate)
+		return true;
+
+	c->tokens += div_u64(min_t(u64, now - c->last_ns, NSEC_PER_SEC) * c->rate,
+			     NSEC_PER_SEC);
+	c->tokens = min(c->tokens, c->burst);
+	c->last_ns = now;
+	if (c->tokens >= len)
+		return true;
+
+	need = div64_u64((len - c->tokens) * NSEC_PER_SEC, c->rate) + 1;
+	*wait_ns = min(*wait_ns, need);
+
+	return false;
+}
+
+static struct test_sched_req *test_sched_pick(struct test_sched *s,
+					      size_t *len, u64 *wait_ns)
+{
+	struct test_sched_req *req;
+	u64 now = ktime_get_ns();
+	int prio;
+
+	for (prio = 0; prio < TEST_SCHED_NR_PRIO; prio++) {
+		list_for_each_entry(req, &s->queue[prio], node) {
+			*len = min(s->chunk, req->len - req->done);
+			if (!test_sched_admit(req->client, *len, now, wait_ns))
+				continue;
+			if (req->client->rate)
+				req->client->tokens -= *len;
+			return req;
+		}
+	}
+
+	return NULL;
+}
+
+static int test_sched_thread(void *data)
+{
+	struct test_sched *s = data;
+	struct test_sched_req *req;
+	enum test_dir dir;
+	unsigned long seq;
+	u64 wait_ns, t0;
+	size_t len;
+	int ret;
+
+	while (!kthread_should_stop()) {
+		wait_ns = U64_MAX;
+		spin_lock(&s->lock);
+		seq = s->seq;
+		req = test_sched_pick(s, &len, &wait_ns);
+		spin_unlock(&s->lock);
+
+		if (!req) {
+			wait_event_interruptible_timeout(s->wq,
+				READ_ONCE(s->seq) != seq || kthread_should_stop(),
+				wait_ns == U64_MAX ? MAX_SCHEDULE_TIMEOUT :
+				max(nsecs_to_jiffies(wait_ns), 1UL));
+			continue;
+		}
+
+		t0 = ktime_get_ns();
+		ret = test_memcpy_dma(s->chan, req->dst + req->done,
+				      req->src + req->done, len);
+		dir = req->dst >= s->priv->fixmem_paddr &&
+		      req->dst < s->priv->fixmem_paddr + s->priv->len ?
+		      TEST_DIR_TO_FIX : TEST_DIR_FROM_FIX;
+		test_telem_account(s->priv, TEST_ENG_DMA, dir, len,
+				   ktime_get_ns() - t0, ret);
+
+		spin_lock(&s->lock);
+		req->done += len;
+		if (ret || req->done == req->len) {
+			list_del(&req->node);
+			req->ret = ret;
+			complete(&req->cmp);
+		}
+		spin_unlock(&s->lock);
+	}
+
+	return 0;
+}
+
+static int test_sched_submit(struct test_sched *s, struct test_sched_client *c,
+			     dma_addr_t dst, dma_addr_t src, size_t len)
+{
+	struct test_sched_req req = {
+		.client = c,
+		.dst = dst,
+		.src = src,
+		.len = len,
+	};
+
+	init_completion(&req.cmp);
+
+	spin_lock(&s->lock);
+	list_add_tail(&req.node, &s->queue[c->prio]);
+	s->seq++;
+	spin_unlock(&s->lock);
+	wake_up(&s->wq);
+
+	wait_for_completion(&req.cmp);
+
+	return req.ret;
+}
+
+static int test_sched_start(struct test_sched *s, struct test_rmem_priv *priv,
+			    struct dma_chan *chan, size_t chunk)
+{
+	int prio;
+
+	s->priv = priv;
+	s->chan = chan;
+	s->chunk = chunk;
+	spin_lock_init(&s->lock);
+	for (prio = 0; prio < TEST_SCHED_NR_PRIO; prio++)
+		INIT_LIST_HEAD(&s->queue[prio]);
+	init_waitqueue_head(&s->wq);
+
+	s->task = kthread_run(test_sched_thread, s, "rmem-sched");
+
+	return PTR_ERR_OR_ZERO(s->task);
+}
+
+static void test_sched_stop(struct test_sched *s)
+{
+	kthread_stop(s->task);
+}
+
+struct test_sched_bulk {
+	struct test_sched *s;
+	struct test_sched_client client;
+	dma_addr_t dst, src;
+	size_t len;
+	atomic64_t *bytes;
+	struct task_struct *task;
+};
+
+static int test_sched_bulk_thread(void *data)
+{
+	struct test_sched_bulk *b = data;
+
+	while (!kthread_should_stop()) {
+		if (test_sched_submit(b->s, &b->client, b->dst, b->src, b->len)) {
+			msleep_interruptible(10);
+			continue;
+		}
+		atomic64_add(b->len, b->bytes);
+	}
+
+	return 0;
+}
+
+static int test_sched_phase(struct test_rmem_priv *priv, const char *name,
+			    dma_addr_t src_paddr, unsigned int nr_bulk,
+			    bool prioritized)
+{
+	size_t chunk = prioritized ? clamp_t(size_t, sched_chunk, 64, priv->len) :
+				     priv->len;
+	size_t hp_len = clamp_t(size_t, sched_hp_size, 4, priv->len);
+	struct test_sched_client hp;
+	struct test_sched_bulk *bulk;
+	struct test_sched s;
+	struct test_stat st;
+	atomic64_t bytes;
+	u64 t0, t1, start;
+	unsigned int i, nr_started = 0;
+	int ret;
+
+	bulk = kcalloc(nr_bulk, sizeof(*bulk), GFP_KERNEL);
+	if (nr_bulk && !bulk)
+		return -ENOMEM;
+
+	ret = test_sched_start(&s, priv, priv->chan, chunk);
+	if (ret)
+		goto out_free;
+
+	atomic64_set(&bytes, 0);
+	test_sched_client_init(&s, &hp, prioritized ? TEST_SCHED_HIGH :
+			       TEST_SCHED_NORMAL, 0);
+	for (i = 0; i < nr_bulk; i++) {
+		bulk[i].s = &s;
+		bulk[i].dst = priv->fixmem_paddr;
+		bulk[i].src = src_paddr;
+		bulk[i].len = priv->len;
+		bulk[i].bytes = &bytes;
+		test_sched_client_init(&s, &bulk[i].client,
+				       prioritized ? TEST_SCHED_BULK : TEST_SCHED_NORMAL,
+				       prioritized ? (u64)sched_bulk_rate * SZ_1M : 0);
+		bulk[i].task = kthread_run(test_sched_bulk_thread, &bulk[i],
+					   "rmem-bulk/%u", i);
+		if (IS_ERR(bulk[i].task)) {
+			ret = PTR_ERR(bulk[i].task);
+			goto out_stop;
+		}
+		nr_started++;
+	}
+
+	test_stat_init(&st);
+	start = ktime_get_ns();
+	for (i = 0; i < test_loops; i++) {
+		t0 = ktime_get_ns();
+		ret = test_sched_submit(&s, &hp, priv->fixmem_paddr, src_paddr,
+					hp_len);
+		t1 = ktime_get_ns();
+		if (ret)
+			break;
+		test_stat_add(&st, t1 - t0);
+		usleep_range(100, 200);
+	}
+	t1 = ktime_get_ns() - start;
+
+	test_stat_report(priv, name, hp_len, &st);
+	if (nr_bulk)
+		dev_info(priv->dev, "%s: bulk x%u %llu MB/s\n", name, nr_bulk,
+			 div64_u64(atomic64_read(&bytes) * 1000, max(t1, 1ULL)));
+
+out_stop:
+	for (i = 0; i < nr_started; i++)
+		kthread_stop(bulk[i].task);
+	test_sched_stop(&s);
+out_free:
+	kfree(bulk);
+
+	return ret;
+}
+
+static int test_rmem_sched(struct test_rmem_priv *priv)
+{
+	struct device *dev = priv->dev;
+	struct device *chan_dev = priv->chan_dev;
+	dma_addr_t src_paddr;
+	int ret;
+
+	test_memory_init(priv->src_addr, priv->fixmem_addr, priv->dst_addr,
+			 priv->len);
+
+	src_paddr = dma_map_single(chan_dev, priv->src_addr, priv->len,
+				   DMA_TO_DEVICE);
+	ret = dma_mapping_error(chan_dev, src_paddr);
+	if (ret) {
+		dev_err(dev, "Failed to map src (%d)\n", ret);
+		return ret;
+	}
+
+	/* high priority latency alone, against FIFO bulk and scheduled bulk */
+	ret = test_sched_phase(priv, "SCHED idle", src_paddr, 0, false);
+	if (!ret)
+		ret = test_sched_phase(priv, "SCHED fifo", src_paddr,
+				       sched_bulk_threads, false);
+	if (!ret)
+		ret = test_sched_phase(priv, "SCHED prio", src_paddr,
+				       sched_bulk_threads, true);
+
+	dma_unmap_single(chan_dev, src_paddr, priv->len, DMA_TO_DEVICE);
+
+	return ret;
+}
+
+struct test_chan_filter {
+	int node;
+	bool local;
+};
+
+static bool test_chan_filter_node(struct dma_chan *chan, void *param)
+{
+	struct test_chan_filter *f = param;
+	int node = dev_to_node(dmaengine_get_dma_device(chan));
+
+	return (node == f->node) == f->local;
+}
+
+/*
+ * Node of the reserved region, ours where the platform cannot tell.  Both
+ * channel selection and the local/remote split of the NUMA test use it.
+ * Without CONFIG_NUMA_KEEP_MEMINFO phys_to_target_node() is a stub that
+ * says node 0 for everything, so it is not asked.
+ */
+static int test_region_node(struct test_rmem_priv *priv)
+{
+	int node = NUMA_NO_NODE;
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 10, 0)
+	if (IS_ENABLED(CONFIG_NUMA_KEEP_MEMINFO) && priv->rmem)
+		node = phys_to_target_node(priv->rmem->base);
+#endif
+
+	return node == NUMA_NO_NODE ? numa_mem_id() : node;
+}
+
+static struct dma_chan *test_request_chan(int node, bool local)
+{
+	struct test_chan_filter f = { .node = node, .local = local };
+	dma_cap_mask_t mask;
+
+	dma_cap_zero(mask);
+	dma_cap_set(DMA_MEMCPY, mask);
+	if (node == NUMA_NO_NODE)
+		return dma_request_channel(mask, NULL, NULL);
+
+	return dma_request_channel(mask, test_chan_filter_node, &f);
+}
+
+/* Map the test buffers for a channel that may belong to another device */
+static int test_chan_map(struct test_rmem_priv *priv, struct test_chan_map *m,
+			 struct dma_chan *chan)
+{
+	struct device *dev = dmaengine_get_dma_device(chan);
+	size_t len = priv->len;
+	int ret;
+
+	m->chan = chan;
+	m->dev = dev;
+
+	m->src = dma_map_single(dev, priv->src_addr, len, DMA_TO_DEVICE);
+	ret = dma_mapping_error(dev, m->src);
+	if (ret)
+		return ret;
+
+	m->dst = dma_map_single(dev, priv->dst_addr, len, DMA_FROM_DEVICE);
+	ret = dma_mapping_error(dev, m->dst);
+	if (ret)
+		goto err_unmap_src;
+
+	if (dev == priv->chan_dev) {
+		m->fix = priv->fixmem_paddr;
+		return 0;
+	}
+
+	m->fix = dma_map_resource(dev, priv->fixmem_phys, len,
+				  DMA_BIDIRECTIONAL, 0);
+	ret = dma_mapping_error(dev, m->fix);
+	if (ret)
+		goto err_unmap_dst;
+
+	return 0;
+
+err_unmap_dst:
+	dma_unmap_single(dev, m->dst, len, DMA_FROM_DEVICE);
+err_unmap_src:
+	dma_unmap_single(dev, m->src, len, DMA_TO_DEVICE);
+
+	return ret;
+}
+
+static void test_chan_unmap(struct test_rmem_priv *priv, struct test_chan_map *m)
+{
+	size_t len = priv->len;
+
+	if (m->dev != priv->chan_dev)
+		dma_unmap_resource(m->dev, m->fix, len, DMA_BIDIRECTIONAL, 0);
+	dma_unmap_single(m->dev, m->dst, len, DMA_FROM_DEVICE);
+	dma_unmap_single(m->dev, m->src, len, DMA_TO_DEVICE);
+}
+
+static int test_bench_dma(struct test_rmem_priv *priv, struct dma_chan *chan,
+			  dma_addr_t dst, dma_addr_t src, size_t len,
+			  struct test_stat *st)
+{
+	unsigned int i;
+	u64 t0;
+	int ret;
+
+	test_stat_init(st);
+	for (i = 0; i < test_loops; i++) {
+		t0 = test_time_now(priv);
+		ret = test_memcpy_dma(chan, dst, src, len);
+		if (ret)
+			return ret;
+		test_time_add(priv, st, t0, 1);
+	}
+
+	return 0;
+}
+
+static int test_numa_bench(struct test_rmem_priv *priv, struct dma_chan *chan,
+			   const char *where)
+{
+	struct test_chan_map m;
+	struct test_stat st;
+	char name[32];
+	int ret;
+
+	dev_info(priv->dev, "NUMA: %s %s node%d\n", where, dma_chan_name(chan),
+		 dev_to_node(dmaengine_get_dma_device(chan)));
+
+	ret = test_chan_map(priv, &m, chan);
+	if (ret) {
+		dev_err(priv->dev, "Failed to map buffers for %s (%d)\n",
+			dma_chan_name(chan), ret);
+		return ret;
+	}
+
+	ret = test_bench_dma(priv, chan, m.fix, m.src, priv->len, &st);
+	if (ret)
+		goto out_unmap;
+	snprintf(name, sizeof(name), "NUMA %s src->fix", where);
+	test_stat_report(priv, name, priv->len, &st);
+
+	ret = test_bench_dma(priv, chan, m.dst, m.fix, priv->len, &st);
+	if (ret)
+		goto out_unmap;
+	snprintf(name, sizeof(name), "NUMA %s fix->dst", where);
+	test_stat_report(priv, name, priv->len, &st);
+
+out_unmap:
+	test_chan_unmap(priv, &m);
+
+	return ret;
+}
+
+static int test_rmem_numa(struct test_rmem_priv *priv)
+{
+	int node = priv->node;
+	struct dma_chan *local, *remote;
+	int ret = 0;
+
+	dev_info(priv->dev, "NUMA: region on node%d, buffers on node%d, selected %s node%d\n",
+		 node, page_to_nid(virt_to_page(priv->src_addr)),
+		 dma_chan_name(priv->chan), dev_to_node(priv->chan_dev));
+
+	local = test_request_chan(node, true);
+	remote = test_request_chan(node, false);
+	if (!local && !remote) {
+		dev_info(priv->dev, "NUMA: no other memcpy channel to compare\n");
+		goto out;
+	}
+
+	if (local)
+		ret = test_numa_bench(priv, local, "local");
+	if (remote && !ret)
+		ret = test_numa_bench(priv, remote, "remote");
+
+out:
+	if (remote)
+		dma_release_channel(remote);
+	if (local)
+		dma_release_channel(local);
+
+	return ret;
+}
+
+static size_t test_size_next(size_t size, size_t len)
+{
+	return size < len ? min(size * 2, len) : 0;
+}
+
+/* iterate 64, 128, ... up to and including len */
+#define for_each_test_size(size, len) \
+	for (size = min_t(size_t, 64, len); size; size = test_size_next(size, len))
+
+#define TEST_SURVEY_MAX_CHANS	32
+
+struct test_survey {
+	struct dma_chan *chan;
+	u64 lat_ns;	/* average at the smallest size */
+	u64 mbps;	/* at the largest size */
+	int ret;
+};
+
+static int test_survey_cmp_lat(const void *a, const void *b)
+{
+	const struct test_survey *x = a, *y = b;
+
+	if (x->ret != y->ret)
+		return x->ret ? 1 : -1;
+
+	return x->lat_ns < y->lat_ns ? -1 : x->lat_ns > y->lat_ns;
+}
+
+static int test_survey_cmp_bw(const void *a, const void *b)
+{
+	const struct test_survey *x = a, *y = b;
+
+	if (x->ret != y->ret)
+		return x->ret ? 1 : -1;
+
+	return x->mbps > y->mbps ? -1 : x->mbps < y->mbps;
+}
+
+static void test_survey_caps(struct test_rmem_priv *priv, struct dma_chan *chan)
+{
+	struct dma_device *dma = chan->device;
+	struct device *dev = dmaengine_get_dma_device(chan);
+
+	dev_info(priv->dev,
+		 "SURVEY: %s (%s) node%d copy_align:%u max_seg:%u dirs:%s%s%s%s\n",
+		 dma_chan_name(chan), dev_name(dev), dev_to_node(dev),
+		 1U << dma->copy_align, dma_get_max_seg_size(dev),
+		 dma->directions & BIT(DMA_MEM_TO_MEM) ? " m2m" : "",
+		 dma->directions & BIT(DMA_MEM_TO_DEV) ? " m2d" : "",
+		 dma->directions & BIT(DMA_DEV_TO_MEM) ? " d2m" : "",
+		 dma->directions & BIT(DMA_DEV_TO_DEV) ? " d2d" : "");
+}
+
+static int test_survey_chan(struct test_rmem_priv *priv, struct test_survey *sv)
+{
+	struct dma_chan *chan = sv->chan;
+	struct test_chan_map m;
+	struct test_stat st;
+	size_t size;
+	int ret;
+
+	test_survey_caps(priv, chan);
+
+	ret = test_chan_map(priv, &m, chan);
+	if (ret)
+		return ret;
+
+	for_each_test_size(size, priv->len) {
+		if (!is_dma_copy_aligned(chan->device, m.src, m.fix, size))
+			continue;
+		ret = test_bench_dma(priv, chan, m.fix, m.src, size, &st);
+		if (ret)
+			break;
+		test_stat_report(priv, dma_chan_name(chan), size, &st);
+		if (!sv->lat_ns)
+			sv->lat_ns = div_u64(st.sum, st.n);
+		sv->mbps = div64_u64((u64)size * st.n * 1000, max(st.sum, 1ULL));
+	}
+
+	test_chan_unmap(priv, &m);
 
 	return ret;
 }
 
+static int test_rmem_survey(struct test_rmem_priv *priv)
+{
+	struct test_survey *sv;
+	struct dma_chan *chan;
+	int i, nr = 0;
+
+	sv = kcalloc(TEST_SURVEY_MAX_CHANS, sizeof(*sv), GFP_KERNEL);
+	if (!sv)
+		return -ENOMEM;
+
+	/* every other free memcpy channel, along with the one we hold */
+	sv[nr++].chan = priv->chan;
+	while (nr < TEST_SURVEY_MAX_CHANS) {
+		chan = test_request_chan(NUMA_NO_NODE, true);
+		if (!chan)
+			break;
+		sv[nr++].chan = chan;
+	}
+
+	for (i = 0; i < nr; i++)
+		sv[i].ret = test_survey_chan(priv, &sv[i]);
+
+	sort(sv, nr, sizeof(*sv), test_survey_cmp_lat, NULL);
+	for (i = 0; i < nr; i++)
+		dev_info(priv->dev, "SURVEY: latency #%d %s %llu ns%s\n", i + 1,
+			 dma_chan_name(sv[i].chan), sv[i].lat_ns,
+			 sv[i].ret ? " (failed)" : "");
+
+	sort(sv, nr, sizeof(*sv), test_survey_cmp_bw, NULL);
+	for (i = 0; i < nr; i++)
+		dev_info(priv->dev, "SURVEY: bandwidth #%d %s %llu MB/s%s\n", i + 1,
+			 dma_chan_name(sv[i].chan), sv[i].mbps,
+			 sv[i].ret ? " (failed)" : "");
+
+	for (i = 0; i < nr; i++)
+		if (sv[i].chan != priv->chan)
+			dma_release_channel(sv[i].chan);
+	kfree(sv);
+
+	return 0;
+}
+
+static int test_bench_slave(struct test_rmem_priv *priv, const char *name,
+			    bool sg, enum dma_transfer_direction dir,
+			    dma_addr_t buf, dma_addr_t fix)
+{
+	struct dma_chan *chan = priv->slave_chan;
+	struct test_stat st;
+	unsigned int i;
+	u64 t0;
+	int ret;
+
+	test_stat_init(&st);
+	for (i = 0; i < test_loops; i++) {
+		t0 = test_time_now(priv);
+		if (sg)
+			ret = test_slave_sg_dma(chan, dir, buf, fix, priv->len);
+		else
+			ret = test_slave_dma(chan, dir, buf, fix, priv->len);
+		if (ret)
+			return ret;
+		test_time_add(priv, &st, t0, 1);
+	}
+	test_stat_report(priv, name, priv->len, &st);
+
+	return 0;
+}
+
+static int test_rmem_slave(struct test_rmem_priv *priv)
+{
+	struct device *dev = priv->dev;
+	struct test_chan_map m;
+	struct test_stat st;
+	size_t len = priv->len;
+	u32 crc1, crc2;
+	int ret;
+
+	if (!priv->slave_chan) {
+		dev_info(dev, "SLAVE: no \"rmem\" slave channel\n");
+		return 0;
+	}
+
+	test_memory_init(priv->src_addr, priv->fixmem_addr, priv->dst_addr, len);
+
+	ret = test_chan_map(priv, &m, priv->slave_chan);
+	if (ret) {
+		dev_err(dev, "Failed to map buffers for %s (%d)\n",
+			dma_chan_name(priv->slave_chan), ret);
+		return ret;
+	}
+
+	ret = test_slave_dma(priv->slave_chan, DMA_MEM_TO_DEV, m.src, m.fix, len);
+	if (ret) {
+		dev_err(dev, "Failed to transfer src->fix by slave dma\n");
+		goto out_unmap;
+	}
+	crc1 = crc32_le(0, priv->src_addr, len);
+	crc2 = crc32_le(0, priv->fixmem_addr, len);
+	dev_info(dev, "SLAVE: src:%llx -> fix:%llx %s\n", m.src, m.fix,
+		 (crc1 == crc2) ? "OK" : "NG");
+
+	ret = test_bench_slave(priv, "SLAVE single src->fix", false,
+			       DMA_MEM_TO_DEV, m.src, m.fix);
+	if (!ret)
+		ret = test_bench_slave(priv, "SLAVE single fix->dst", false,
+				       DMA_DEV_TO_MEM, m.dst, m.fix);
+	if (!ret)
+		ret = test_bench_slave(priv, "SLAVE sg src->fix", true,
+				       DMA_MEM_TO_DEV, m.src, m.fix);
+	if (!ret)
+		ret = test_bench_slave(priv, "SLAVE sg fix->dst", true,
+				       DMA_DEV_TO_MEM, m.dst, m.fix);
+	test_chan_unmap(priv, &m);
+	if (ret || priv->chan_slave)
+		return ret;
+
+	/* the memcpy path on the channel we hold, for comparison */
+	ret = test_chan_map(priv, &m, priv->chan);
+	if (ret)
+		return ret;
+	ret = test_bench_dma(priv, priv->chan, m.fix, m.src, len, &st);
+	if (!ret)
+		test_stat_report(priv, "SLAVE memcpy src->fix", len, &st);
+	if (!ret)
+		ret = test_bench_dma(priv, priv->chan, m.dst, m.fix, len, &st);
+	if (!ret)
+		test_stat_report(priv, "SLAVE memcpy fix->dst", len, &st);
+
+out_unmap:
+	test_chan_unmap(priv, &m);
+
+	return ret;
+}
+
+/*
+ * Auto-tuner: for each size class, search DMA queue depth, chunk size,
+ * number of channels and the share copied by the CPU for the fastest
+ * src->fix copy. The DMA part starts at offset 0 and the CPU copies the
+ * tail while the DMA is in flight.
+ */
+static const unsigned int test_tune_depths[] = { 1, 2, 4, TEST_TUNE_MAX_DEPTH };
+static const unsigned int test_tune_cpu_pcts[] = { 0, 25, 50, 100 };
+
+static int test_tune_copy(struct test_rmem_priv *priv, struct test_chan_map *maps,
+			  size_t size, const struct test_tune_cfg *cfg)
+{
+	dma_cookie_t ring[TEST_TUNE_MAX_CHANS][TEST_TUNE_MAX_DEPTH];
+	unsigned int head[TEST_TUNE_MAX_CHANS] = { };
+	unsigned int inflight[TEST_TUNE_MAX_CHANS] = { };
+	enum dma_ctrl_flags flags = DMA_PREP_INTERRUPT | DMA_CTRL_ACK;
+	size_t cpu_len = ALIGN_DOWN(size * cfg->cpu_pct / 100, 64);
+	size_t dma_len = size - cpu_len;
+	struct dma_async_tx_descriptor *tx;
+	struct dma_chan *chan;
+	unsigned int c, i = 0, slot;
+	size_t off, n;
+	int ret = 0;
+
+	for (off = 0; off < dma_len; off += n, i++) {
+		c = i % cfg->nr_chans;
+		chan = maps[c].chan;
+		n = min_t(size_t, cfg->chunk, dma_len - off);
+
+		if (inflight[c] == cfg->depth) {
+			if (dma_sync_wait(chan, ring[c][head[c]]) != DMA_COMPLETE) {
+				ret = -EIO;
+				goto out;
+			}
+			head[c] = (head[c] + 1) % cfg->depth;
+			inflight[c]--;
+		}
+
+		tx = dmaengine_prep_dma_memcpy(chan, maps[c].fix + off,
+					       maps[c].src + off, n, flags);
+		if (!tx) {
+			ret = -ENODEV;
+			goto out;
+		}
+		slot = (head[c] + inflight[c]) % cfg->depth;
+		ring[c][slot] = dmaengine_submit(tx);
+		if (dma_submit_error(ring[c][slot])) {
+			ret = -EINVAL;
+			goto out;
+		}
+		inflight[c]++;
+		dma_async_issue_pending(chan);
+	}
+
+	if (cpu_len)
+		memcpy(priv->fixmem_addr + dma_len, priv->src_addr + dma_len,
+		       cpu_len);
+
+	/* completions are in order, so the newest cookie covers the rest */
+	for (c = 0; c < cfg->nr_chans; c++) {
+		if (!inflight[c])
+			continue;
+		slot = (head[c] + inflight[c] - 1) % cfg->depth;
+		if (dma_sync_wait(maps[c].chan, ring[c][slot]) != DMA_COMPLETE) {
+			ret = -EIO;
+			goto out;
+		}
+		inflight[c] = 0;
+	}
+
+out:
+	for (c = 0; c < cfg->nr_chans; c++)
+		if (inflight[c])
+			dmaengine_terminate_sync(maps[c].chan);
+
+	return ret;
+}
+
+static int test_tune_measure(struct test_rmem_priv *priv,
+			     struct test_chan_map *maps, size_t size,
+			     struct test_tune_cfg *cfg)
+{
+	unsigned int i, loops = max(tune_loops, 1U);
+	u64 t0, sum = 0;
+	int ret;
+
+	for (i = 0; i < loops; i++) {
+		t0 = ktime_get_ns();
+		ret = test_tune_copy(priv, maps, size, cfg);
+		if (ret)
+			return ret;
+		sum += ktime_get_ns() - t0;
+	}
+	cfg->ns = div_u64(sum, loops);
+
+	return 0;
+}
+
+static int test_tune_class(struct test_rmem_priv *priv,
+			   struct test_chan_map *maps, unsigned int nr_maps,
+			   size_t size, struct test_tune_cfg *best)
+{
+	unsigned int max_seg = dma_get_max_seg_size(priv->chan_dev);
+	struct test_tune_cfg cfg = { };
+	unsigned int d, p;
+	size_t chunk;
+	int ret;
+
+	best->ns = U64_MAX;
+
+	/* DMA only first, then split the best DMA setup with the CPU */
+	for (cfg.nr_chans = 1; cfg.nr_chans <= nr_maps; cfg.nr_chans++) {
+		for (d = 0; d < ARRAY_SIZE(test_tune_depths); d++) {
+			cfg.depth = test_tune_depths[d];
+			for (chunk = min_t(size_t, SZ_4K, size); chunk;
+			     chunk = chunk < size ? min(chunk * 4, size) : 0) {
+				if (chunk > max_seg)
+					break;
+				cfg.chunk = chunk;
+				ret = test_tune_measure(priv, maps, size, &cfg);
+				if (ret)
+					return ret;
+				if (cfg.ns < best->ns)
+					*best = cfg;
+			}
+		}
+	}
+
+	cfg = *best;
+	for (p = 1; p < ARRAY_SIZE(test_tune_cpu_pcts); p++) {
+		cfg.cpu_pct = test_tune_cpu_pcts[p];
+		ret = test_tune_measure(priv, maps, size, &cfg);
+		if (ret)
+			return ret;
+		if (cfg.ns < best->ns)
+			*best = cfg;
+	}
+
+	best->size = size;
+
+	return 0;
+}
+
+/*
+ * Calibration record kept in the first page of the reserved region, which
+ * is not cleared by a warm reboot. The dma coherent pool zeroes what it
+ * hands out, so the page is read through its own mapping before the slice
+ * is allocated and the record is written back afterwards.
+ */
+static u32 test_calib_fingerprint(struct test_rmem_priv *priv)
+{
+	u64 region[2] = { priv->rmem->base, priv->rmem->size };
+	u32 fp;
+
+	fp = crc32_le(~0, (const u8 *)dev_name(priv->chan_dev),
+		      strlen(dev_name(priv->chan_dev)));
+	fp = crc32_le(fp, (const u8 *)dma_chan_name(priv->chan),
+		      strlen(dma_chan_name(priv->chan)));
+	fp = crc32_le(fp, (const u8 *)region, sizeof(region));
+	fp = crc32_le(fp, (const u8 *)&priv->len, sizeof(priv->len));
+
+	return fp;
+}
+
+static u32 test_calib_crc(struct test_calib_rec *rec)
+{
+	return crc32_le(~0, (const u8 *)rec, offsetof(struct test_calib_rec, crc));
+}
+
+static void test_calib_store(struct test_rmem_priv *priv)
+{
+	struct test_calib_rec rec = { };
+	unsigned int i;
+
+	if (!priv->calib || !tune_persist)
+		return;
+
+	rec.magic = cpu_to_le32(TEST_CALIB_MAGIC);
+	rec.version = cpu_to_le16(TEST_CALIB_VERSION);
+	rec.nr_tune = cpu_to_le16(priv->nr_tune);
+	rec.fingerprint = cpu_to_le32(test_calib_fingerprint(priv));
+	rec.crossover = cpu_to_le32(priv->crossover);
+	for (i = 0; i < priv->nr_tune; i++) {
+		rec.tune[i].size = cpu_to_le32(priv->tune[i].size);
+		rec.tune[i].depth = cpu_to_le32(priv->tune[i].depth);
+		rec.tune[i].chunk = cpu_to_le32(priv->tune[i].chunk);
+		rec.tune[i].nr_chans = cpu_to_le32(priv->tune[i].nr_chans);
+		rec.tune[i].cpu_pct = cpu_to_le32(priv->tune[i].cpu_pct);
+		rec.tune[i].ns = cpu_to_le64(priv->tune[i].ns);
+	}
+	rec.crc = cpu_to_le32(test_calib_crc(&rec));
+
+	memcpy(priv->calib, &rec, sizeof(rec));
+}
+
+static bool test_calib_parse(struct test_rmem_priv *priv,
+			     struct test_calib_rec *rec)
+{
+	unsigned int i, nr = le16_to_cpu(rec->nr_tune);
+
+	if (le32_to_cpu(rec->magic) != TEST_CALIB_MAGIC ||
+	    le16_to_cpu(rec->version) != TEST_CALIB_VERSION ||
+	    le32_to_cpu(rec->crc) != test_calib_crc(rec) ||
+	    !nr || nr > ARRAY_SIZE(priv->tune))
+		return false;
+
+	if (le32_to_cpu(rec->fingerprint) != test_calib_fingerprint(priv)) {
+		dev_info(priv->dev, "CALIB: hardware changed, recalibrating\n");
+		return false;
+	}
+
+	for (i = 0; i < nr; i++) {
+		priv->tune[i].size = le32_to_cpu(rec->tune[i].size);
+		priv->tune[i].depth = le32_to_cpu(rec->tune[i].depth);
+		priv->tune[i].chunk = le32_to_cpu(rec->tune[i].chunk);
+		priv->tune[i].nr_chans = le32_to_cpu(rec->tune[i].nr_chans);
+		priv->tune[i].cpu_pct = le32_to_cpu(rec->tune[i].cpu_pct);
+		priv->tune[i].ns = le64_to_cpu(rec->tune[i].ns);
+	}
+	priv->nr_tune = nr;
+	priv->crossover = le32_to_cpu(rec->crossover);
+
+	return true;
+}
+
+/*
+ * Physical address behind a CPU pointer into the coherent pool, taken
+ * from the pool's mapping of the region.  The DMA address of the same
+ * memory differs from it behind an IOMMU or with dma-ranges offsets.
+ */
+static phys_addr_t test_pool_phys(void *addr)
+{
+	if (is_vmalloc_addr(addr))
+		return ((phys_addr_t)vmalloc_to_pfn(addr) << PAGE_SHIFT) +
+		       offset_in_page(addr);
+
+	return virt_to_phys(addr);
+}
+
+static void test_calib_init(struct test_rmem_priv *priv)
+{
+	struct device *dev = priv->dev;
+	struct test_calib_rec rec;
+	void *page;
+
+	if (!priv->rmem || !tune_persist)
+		return;
+
+	page = memremap(priv->rmem->base, sizeof(rec), MEMREMAP_WC);
+	if (!page)
+		return;
+	memcpy(&rec, page, sizeof(rec));
+	memunmap(page);
+
+	/* first allocation from the pool, so it lands at the region base */
+	priv->calib = dma_alloc_attrs(priv->chan_dev, PAGE_SIZE,
+				      &priv->calib_paddr, GFP_KERNEL, 0);
+	if (!priv->calib)
+		return;
+	if (test_pool_phys(priv->calib) != priv->rmem->base) {
+		dev_warn(dev, "CALIB: slice not at region base, not persisting\n");
+		dma_free_attrs(priv->chan_dev, PAGE_SIZE, priv->calib,
+			       priv->calib_paddr, 0);
+		priv->calib = NULL;
+		return;
+	}
+
+	/*
+	 * The allocation cleared the slice, so put a valid record back.  An
+	 * invalid one is left cleared until a real tune stores its result.
+	 */
+	priv->calib_loaded = test_calib_parse(priv, &rec);
+	if (priv->calib_loaded) {
+		dev_info(dev, "CALIB: restored %u size classes\n", priv->nr_tune);
+		test_calib_store(priv);
+	}
+}
+
+static void test_calib_exit(struct test_rmem_priv *priv)
+{
+	if (priv->calib)
+		dma_free_attrs(priv->chan_dev, PAGE_SIZE, priv->calib,
+			       priv->calib_paddr, 0);
+}
+
+static void test_tune_report(struct test_rmem_priv *priv,
+			     struct test_tune_cfg *cfg, bool saved)
+{
+	struct test_stat st;
+
+	dev_info(priv->dev,
+		 "TUNE: %zu bytes depth:%u chunk:%u chans:%u cpu:%u%% %llu ns%s\n",
+		 cfg->size, cfg->depth, cfg->chunk, cfg->nr_chans, cfg->cpu_pct,
+		 cfg->ns, saved ? " (saved)" : "");
+
+	test_stat_init(&st);
+	test_stat_add(&st, cfg->ns);
+	test_result_add(priv, "TUNE best", cfg->size, &st);
+}
+
+static int test_rmem_tune(struct test_rmem_priv *priv)
+{
+	struct test_chan_map maps[TEST_TUNE_MAX_CHANS];
+	unsigned int i, nr_maps = 0;
+	struct test_tune_cfg *cfg;
+	struct dma_chan *chan;
+	int ret = 0;
+
+	if (priv->chan_slave) {
+		dev_info(priv->dev, "TUNE: needs a memcpy channel\n");
+		return 0;
+	}
+
+	if (priv->calib_loaded && !tune_force) {
+		for (i = 0; i < priv->nr_tune; i++)
+			test_tune_report(priv, &priv->tune[i], true);
+		return 0;
+	}
+
+	while (nr_maps < clamp_t(unsigned int, tune_max_chans, 1,
+				 TEST_TUNE_MAX_CHANS)) {
+		chan = nr_maps ? test_request_chan(priv->node, true) : priv->chan;
+		if (!chan && nr_maps)
+			chan = test_request_chan(NUMA_NO_NODE, true);
+		if (!chan)
+			break;
+		ret = test_chan_map(priv, &maps[nr_maps], chan);
+		if (ret) {
+			if (chan != priv->chan)
+				dma_release_channel(chan);
+			goto out_release;
+		}
+		nr_maps++;
+	}
+
+	priv->nr_tune = 0;
+	priv->crossover = 0;
+	for (i = 0; i < ARRAY_SIZE(test_tune_sizes); i++) {
+		if (test_tune_sizes[i] > priv->len)
+			break;
+		cfg = &priv->tune[priv->nr_tune];
+		ret = test_tune_class(priv, maps, nr_maps, test_tune_sizes[i], cfg);
+		if (ret)
+			break;
+		test_tune_report(priv, cfg, false);
+		if (!priv->crossover && cfg->cpu_pct < 100)
+			priv->crossover = cfg->size;
+		priv->nr_tune++;
+	}
+	if (!ret) {
+		dev_info(priv->dev, "TUNE: DMA pays off from %u bytes\n",
+			 priv->crossover);
+		test_calib_store(priv);
+	}
+
+out_release:
+	for (i = 0; i < nr_maps; i++) {
+		test_chan_unmap(priv, &maps[i]);
+		if (maps[i].chan != priv->chan)
+			dma_release_channel(maps[i].chan);
+	}
+
+	return ret;
+}
+
+/*
+ * Fused CPU kernel, csum_partial_copy style: each block of src is read once
+ * into a small stack block, checksummed there while it is hot and written
+ * out to dst, so dst is never read back.  This checks what was read, not
+ * what landed in dst; the copy+verify passes above do that.
+ */
+static u32 test_copy_crc32(void *dst, const void *src, size_t len, u32 crc)
+{
+	u64 blk[32];
+	size_t n;
+
+	while (len) {
+		n = min(len, sizeof(blk));
+		memcpy(blk, src, n);
+		crc = crc32_le(crc, (u8 *)blk, n);
+		memcpy(dst, blk, n);
+		src += n;
+		dst += n;
+		len -= n;
+	}
+
+	return crc;
+}
+
+static int test_rmem_fused(struct test_rmem_priv *priv)
+{
+	struct device *dev = priv->dev;
+	void *src_addr = priv->src_addr;
+	void *fixmem_addr = priv->fixmem_addr;
+	void *dst_addr = priv->dst_addr;
+	size_t len = priv->len;
+	struct test_stat st;
+	u32 ref, crc1, crc2;
+	bool ok = true;
+	unsigned int i;
+	u64 t0;
+
+	test_memory_init(src_addr, fixmem_addr, dst_addr, len);
+	ref = crc32_le(0, src_addr, len);
+
+	/* copy, then verify both sides as the CPU test does */
+	test_stat_init(&st);
+	for (i = 0; i < test_loops; i++) {
+		t0 = test_time_now(priv);
+		memcpy(fixmem_addr, src_addr, len);
+		crc1 = crc32_le(0, src_addr, len);
+		crc2 = crc32_le(0, fixmem_addr, len);
+		test_time_add(priv, &st, t0, 1);
+		ok &= crc1 == crc2;
+	}
+	test_stat_report(priv, "FUSED copy+verify src->fix", len, &st);
+
+	test_stat_init(&st);
+	for (i = 0; i < test_loops; i++) {
+		t0 = test_time_now(priv);
+		memcpy(dst_addr, fixmem_addr, len);
+		crc1 = crc32_le(0, fixmem_addr, len);
+		crc2 = crc32_le(0, dst_addr, len);
+		test_time_add(priv, &st, t0, 1);
+		ok &= crc1 == crc2;
+	}
+	test_stat_report(priv, "FUSED copy+verify fix->dst", len, &st);
+
+	/* fused, the data read on the way through against src's checksum */
+	test_stat_init(&st);
+	for (i = 0; i < test_loops; i++) {
+		t0 = test_time_now(priv);
+		crc1 = test_copy_crc32(fixmem_addr, src_addr, len, 0);
+		test_time_add(priv, &st, t0, 1);
+		ok &= crc1 == ref;
+	}
+	test_stat_report(priv, "FUSED fused src->fix", len, &st);
+
+	test_stat_init(&st);
+	for (i = 0; i < test_loops; i++) {
+		t0 = test_time_now(priv);
+		crc1 = test_copy_crc32(dst_addr, fixmem_addr, len, 0);
+		test_time_add(priv, &st, t0, 1);
+		ok &= crc1 == ref;
+	}
+	test_stat_report(priv, "FUSED fused fix->dst", len, &st);
+
+	dev_info(dev, "FUSED: src:%px -> fix:%px -> dst:%px %s\n", src_addr,
+		 fixmem_addr, dst_addr, ok ? "OK" : "NG");
+
+	return 0;
+}
+
+/*
+ * Size-class specialised copies. The size is a compile-time constant, so
+ * the loops are fully unrolled for small classes. Stores to fixmem go out
+ * a cache line at a time and are drained with wmb(); loads from fixmem,
+ * which is not cached, keep two lines of loads in flight.
+ */
+enum test_acc {
+	TEST_ACC_TO_FIX,
+	TEST_ACC_FROM_FIX,
+	TEST_ACC_NR,
+};
+
+#define TEST_COPY_LINE(d, s, i)						\
+do {									\
+	u64 a0 = (s)[(i) + 0], a1 = (s)[(i) + 1];			\
+	u64 a2 = (s)[(i) + 2], a3 = (s)[(i) + 3];			\
+	u64 a4 = (s)[(i) + 4], a5 = (s)[(i) + 5];			\
+	u64 a6 = (s)[(i) + 6], a7 = (s)[(i) + 7];			\
+	(d)[(i) + 0] = a0; (d)[(i) + 1] = a1;				\
+	(d)[(i) + 2] = a2; (d)[(i) + 3] = a3;				\
+	(d)[(i) + 4] = a4; (d)[(i) + 5] = a5;				\
+	(d)[(i) + 6] = a6; (d)[(i) + 7] = a7;				\
+} while (0)
+
+#define TEST_COPY_2LINES(d, s, i)					\
+do {									\
+	u64 b0 = (s)[(i) + 0], b1 = (s)[(i) + 1];			\
+	u64 b2 = (s)[(i) + 2], b3 = (s)[(i) + 3];			\
+	u64 b4 = (s)[(i) + 4], b5 = (s)[(i) + 5];			\
+	u64 b6 = (s)[(i) + 6], b7 = (s)[(i) + 7];			\
+	TEST_COPY_LINE(d, s, (i) + 8);					\
+	(d)[(i) + 0] = b0; (d)[(i) + 1] = b1;				\
+	(d)[(i) + 2] = b2; (d)[(i) + 3] = b3;				\
+	(d)[(i) + 4] = b4; (d)[(i) + 5] = b5;				\
+	(d)[(i) + 6] = b6; (d)[(i) + 7] = b7;				\
+} while (0)
+
+#define DEFINE_TEST_COPY(size)						\
+static void test_copy_##size##_to_fix(void *dst, const void *src)	\
+{									\
+	const u64 *s = src;						\
+	u64 *d = dst;							\
+	size_t i;							\
+									\
+	for (i = 0; i < (size) / 8; i += 8)				\
+		TEST_COPY_LINE(d, s, i);				\
+	wmb();								\
+}									\
+									\
+static void test_copy_##size##_from_fix(void *dst, const void *src)	\
+{									\
+	const u64 *s = src;						\
+	u64 *d = dst;							\
+	size_t i = 0;							\
+									\
+	if ((size) >= 128)						\
+		for (; i < (size) / 8; i += 16)				\
+			TEST_COPY_2LINES(d, s, i);			\
+	for (; i < (size) / 8; i += 8)					\
+		TEST_COPY_LINE(d, s, i);				\
+}
+
+DEFINE_TEST_COPY(64)
+DEFINE_TEST_COPY(4096)
+DEFINE_TEST_COPY(65536)
+
+static const struct test_copy_class {
+	size_t size;
+	void (*copy[TEST_ACC_NR])(void *dst, const void *src);
+} test_copy_classes[] = {
+	{ 64,    { test_copy_64_to_fix,    test_copy_64_from_fix } },
+	{ 4096,  { test_copy_4096_to_fix,  test_copy_4096_from_fix } },
+	{ 65536, { test_copy_65536_to_fix, test_copy_65536_from_fix } },
+};
+
+static void test_copy_sized(void *dst, const void *src, size_t len,
+			    enum test_acc acc)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(test_copy_classes); i++) {
+		if (test_copy_classes[i].size == len) {
+			test_copy_classes[i].copy[acc](dst, src);
+			return;
+		}
+	}
+
+	memcpy(dst, src, len);
+}
+
+static void test_sized_bench(struct test_rmem_priv *priv, const char *name,
+			     void *dst, const void *src, size_t len,
+			     enum test_acc acc, bool sized)
+{
+	unsigned int i, j, nr = test_time_batch(len);
+	struct test_stat st;
+	u64 t0;
+
+	test_stat_init(&st);
+	for (i = 0; i < test_loops; i++) {
+		t0 = test_time_now(priv);
+		for (j = 0; j < nr; j++) {
+			if (sized)
+				test_copy_sized(dst, src, len, acc);
+			else
+				memcpy(dst, src, len);
+		}
+		test_time_add(priv, &st, t0, nr);
+	}
+	test_stat_report(priv, name, len, &st);
+}
+
+static int test_rmem_sized(struct test_rmem_priv *priv)
+{
+	void *src_addr = priv->src_addr;
+	void *fixmem_addr = priv->fixmem_addr;
+	void *dst_addr = priv->dst_addr;
+	size_t size;
+	bool ok;
+	int i;
+
+	test_memory_init(src_addr, fixmem_addr, dst_addr, priv->len);
+
+	for (i = 0; i < ARRAY_SIZE(test_copy_classes); i++) {
+		size = test_copy_classes[i].size;
+		if (size > priv->len)
+			break;
+
+		test_copy_sized(fixmem_addr, src_addr, size, TEST_ACC_TO_FIX);
+		test_copy_sized(dst_addr, fixmem_addr, size, TEST_ACC_FROM_FIX);
+		ok = !memcmp(src_addr, dst_addr, size);
+		dev_info(priv->dev, "SIZED: %zu bytes %s\n", size, ok ? "OK" : "NG");
+
+		test_sized_bench(priv, "SIZED memcpy src->fix", fixmem_addr,
+				 src_addr, size, TEST_ACC_TO_FIX, false);
+		test_sized_bench(priv, "SIZED unrolled src->fix", fixmem_addr,
+				 src_addr, size, TEST_ACC_TO_FIX, true);
+		test_sized_bench(priv, "SIZED memcpy fix->dst", dst_addr,
+				 fixmem_addr, size, TEST_ACC_FROM_FIX, false);
+		test_sized_bench(priv, "SIZED unrolled fix->dst", dst_addr,
+				 fixmem_addr, size, TEST_ACC_FROM_FIX, true);
+	}
+
+	return 0;
+}
+
+#define TEST_TELEM_BATCH	64
+
+static void test_telem_bench(struct test_rmem_priv *priv, const char *name,
+			     size_t len, bool on)
+{
+	bool saved = READ_ONCE(telemetry);
+	struct test_stat st;
+	unsigned int i, j;
+	u64 t0, t1;
+
+	WRITE_ONCE(telemetry, on);
+	test_stat_init(&st);
+	for (i = 0; i < test_loops; i++) {
+		t0 = test_time_now(priv);
+		for (j = 0; j < TEST_TELEM_BATCH; j++) {
+			t1 = ktime_get_ns();
+			memcpy(priv->fixmem_addr, priv->src_addr, len);
+			test_telem_account(priv, TEST_ENG_CPU, TEST_DIR_TO_FIX,
+					   len, ktime_get_ns() - t1, 0);
+		}
+		test_time_add(priv, &st, t0, TEST_TELEM_BATCH);
+	}
+	test_stat_report(priv, name, len, &st);
+	WRITE_ONCE(telemetry, saved);
+}
+
+static int test_rmem_telem(struct test_rmem_priv *priv)
+{
+	static const size_t sizes[] = { SZ_64, SZ_4K };
+	int i;
+
+	test_memory_init(priv->src_addr, priv->fixmem_addr, priv->dst_addr,
+			 priv->len);
+
+	for (i = 0; i < ARRAY_SIZE(sizes); i++) {
+		if (sizes[i] > priv->len)
+			break;
+		test_telem_bench(priv, "TELEM off src->fix", sizes[i], false);
+		test_telem_bench(priv, "TELEM on src->fix", sizes[i], true);
+	}
+
+	return 0;
+}
+
+/*
+ * Periodic real-time copy: a SCHED_FIFO thread sleeps on an absolute
+ * hrtimer every rt_period_us and copies rt_size bytes into fixmem, the way
+ * a control loop would.  Wakeup latency (timer expiry to running), copy
+ * latency and deadline misses (copy not done by the next period) are
+ * recorded, optionally with CPU memory load running beside it.
+ */
+struct test_rt {
+	struct test_rmem_priv *priv;
+	bool dma;
+	dma_addr_t src;
+	size_t len;
+	struct test_stat wake, copy;
+	unsigned int wake_hist[TEST_TELEM_BUCKETS];
+	unsigned int copy_hist[TEST_TELEM_BUCKETS];
+	unsigned int misses;
+	int ret;
+	struct completion done;
+};
+
+static int test_rt_thread(void *data)
+{
+	struct test_rt *rt = data;
+	struct test_rmem_priv *priv = rt->priv;
+	u64 period = (u64)max(rt_period_us, 1U) * NSEC_PER_USEC;
+	u64 now, t0, t1;
+	unsigned int i;
+	ktime_t next;
+
+	sched_set_fifo(current);
+
+	next = ktime_add_ns(ktime_get(), period);
+	for (i = 0; i < rt_loops && !kthread_should_stop(); i++) {
+		set_current_state(TASK_UNINTERRUPTIBLE);
+		schedule_hrtimeout_range(&next, 0, HRTIMER_MODE_ABS);
+
+		t0 = ktime_get_ns();
+		if (rt->dma) {
+			rt->ret = test_memcpy_dma(priv->chan, priv->fixmem_paddr,
+						  rt->src, rt->len);
+			if (rt->ret)
+				break;
+		} else {
+			memcpy(priv->fixmem_addr, priv->src_addr, rt->len);
+		}
+		t1 = ktime_get_ns();
+
+		test_stat_add(&rt->wake, t0 - ktime_to_ns(next));
+		test_stat_add(&rt->copy, t1 - t0);
+		rt->wake_hist[test_telem_bucket(t0 - ktime_to_ns(next))]++;
+		rt->copy_hist[test_telem_bucket(t1 - t0)]++;
+
+		/* missed periods are counted and skipped, not caught up */
+		next = ktime_add_ns(next, period);
+		for (now = ktime_get_ns(); ktime_to_ns(next) < now;
+		     next = ktime_add_ns(next, period))
+			rt->misses++;
+	}
+	complete(&rt->done);
+
+	set_current_state(TASK_INTERRUPTIBLE);
+	while (!kthread_should_stop()) {
+		schedule();
+		set_current_state(TASK_INTERRUPTIBLE);
+	}
+	__set_current_state(TASK_RUNNING);
+
+	return 0;
+}
+
+static int test_rt_load_thread(void *data)
+{
+	struct test_rmem_priv *priv = data;
+
+	while (!kthread_should_stop()) {
+		memcpy(priv->dst_addr, priv->src_addr, priv->len);
+		cond_resched();
+	}
+
+	return 0;
+}
+
+static void test_rt_hist(struct test_rmem_priv *priv, const char *name,
+			 const unsigned int *hist)
+{
+	char buf[TEST_TELEM_BUCKETS * 11 + 1];
+	int b, len = 0;
+
+	for (b = 0; b < TEST_TELEM_BUCKETS; b++)
+		len += scnprintf(buf + len, sizeof(buf) - len, " %u", hist[b]);
+	dev_info(priv->dev, "%s hist(log2 us):%s\n", name, buf);
+}
+
+static int test_rt_phase(struct test_rmem_priv *priv, bool dma, bool load,
+			 dma_addr_t src)
+{
+	const char *eng = dma ? "dma" : "cpu", *bg = load ? "load" : "idle";
+	struct task_struct **loaders = NULL;
+	unsigned int i, nr_load = 0;
+	struct task_struct *task;
+	char name[32];
+	struct test_rt *rt;
+	int ret = 0;
+
+	rt = kzalloc(sizeof(*rt), GFP_KERNEL);
+	if (!rt)
+		return -ENOMEM;
+
+	rt->priv = priv;
+	rt->dma = dma;
+	rt->src = src;
+	rt->len = clamp_t(size_t, rt_size, 4, priv->len);
+	test_stat_init(&rt->wake);
+	test_stat_init(&rt->copy);
+	init_completion(&rt->done);
+
+	if (load && rt_load) {
+		loaders = kcalloc(rt_load, sizeof(*loaders), GFP_KERNEL);
+		if (!loaders) {
+			ret = -ENOMEM;
+			goto out_free;
+		}
+		for (; nr_load < rt_load; nr_load++) {
+			loaders[nr_load] = kthread_run(test_rt_load_thread, priv,
+						       "rmem-load/%u", nr_load);
+			if (IS_ERR(loaders[nr_load])) {
+				ret = PTR_ERR(loaders[nr_load]);
+				goto out_stop;
+			}
+		}
+	}
+
+	task = kthread_run(test_rt_thread, rt, "rmem-rt");
+	if (IS_ERR(task)) {
+		ret = PTR_ERR(task);
+		goto out_stop;
+	}
+	wait_for_completion(&rt->done);
+	kthread_stop(task);
+	ret = rt->ret;
+
+	snprintf(name, sizeof(name), "RT %s %s wakeup", eng, bg);
+	test_stat_report(priv, name, rt->len, &rt->wake);
+	test_rt_hist(priv, name, rt->wake_hist);
+	snprintf(name, sizeof(name), "RT %s %s copy", eng, bg);
+	test_stat_report(priv, name, rt->len, &rt->copy);
+	test_rt_hist(priv, name, rt->copy_hist);
+	dev_info(priv->dev, "RT %s %s: %u periods of %u us, %u deadline misses\n",
+		 eng, bg, rt->copy.n, rt_period_us, rt->misses);
+
+out_stop:
+	for (i = 0; i < nr_load; i++)
+		kthread_stop(loaders[i]);
+	kfree(loaders);
+out_free:
+	kfree(rt);
+
+	return ret;
+}
+
+static int test_rmem_rt(struct test_rmem_priv *priv)
+{
+	struct device *chan_dev = priv->chan_dev;
+	dma_addr_t src_paddr = 0;
+	int ret;
+
+	test_memory_init(priv->src_addr, priv->fixmem_addr, priv->dst_addr,
+			 priv->len);
+
+	if (!priv->chan_slave) {
+		src_paddr = dma_map_single(chan_dev, priv->src_addr, priv->len,
+					   DMA_TO_DEVICE);
+		ret = dma_mapping_error(chan_dev, src_paddr);
+		if (ret) {
+			dev_err(priv->dev, "Failed to map src (%d)\n", ret);
+			return ret;
+		}
+	}
+
+	ret = test_rt_phase(priv, false, false, 0);
+	if (!ret && rt_load)
+		ret = test_rt_phase(priv, false, true, 0);
+	if (!ret && !priv->chan_slave) {
+		ret = test_rt_phase(priv, true, false, src_paddr);
+		if (!ret && rt_load)
+			ret = test_rt_phase(priv, true, true, src_paddr);
+	}
+
+	if (!priv->chan_slave)
+		dma_unmap_single(chan_dev, src_paddr, priv->len, DMA_TO_DEVICE);
+
+	return ret;
+}
+
+/*
+ * Several submitters on one channel.  Each kthread prepares, submits and
+ * waits for its own descriptor through the completion callback, on its own
+ * slice of the buffers, so the only thing shared is the provider.  The
+ * time spent in prep+submit grows with N when the provider serialises on
+ * a channel lock.
+ */
+#define TEST_SUBMIT_TIMEOUT_MS	3000
+
+struct test_submitter {
+	struct dma_chan *chan;
+	bool chan_public;	/* shared with other async_tx users */
+	dma_cookie_t cookie;
+	dma_addr_t dst, src;
+	size_t len;
+	int cpu;
+	struct test_stat submit, lat;
+	struct completion *go;
+	struct completion done;
+	struct completion xfer;
+	struct task_struct *task;
+	int ret;
+};
+
+static void test_submit_callback(void *param)
+{
+	complete(param);
+}
+
+static int test_submit_one(struct test_submitter *sb)
+{
+	struct dma_chan *chan = sb->chan;
+	struct dma_async_tx_descriptor *tx;
+	dma_cookie_t cookie;
+	u64 t0, t1;
+
+	reinit_completion(&sb->xfer);
+	t0 = ktime_get_ns();
+	tx = dmaengine_prep_dma_memcpy(chan, sb->dst, sb->src, sb->len,
+				       DMA_PREP_INTERRUPT | DMA_CTRL_ACK);
+	if (!tx)
+		return -ENOMEM;
+	tx->callback = test_submit_callback;
+	tx->callback_param = &sb->xfer;
+	cookie = dmaengine_submit(tx);
+	if (dma_submit_error(cookie))
+		return -EINVAL;
+	sb->cookie = cookie;
+	dma_async_issue_pending(chan);
+	t1 = ktime_get_ns();
+
+	if (!wait_for_completion_timeout(&sb->xfer,
+				msecs_to_jiffies(TEST_SUBMIT_TIMEOUT_MS)))
+		return -ETIMEDOUT;
+
+	test_stat_add(&sb->submit, t1 - t0);
+	test_stat_add(&sb->lat, ktime_get_ns() - t0);
+
+	return 0;
+}
+
+static int test_submit_thread(void *data)
+{
+	struct test_submitter *sb = data;
+	unsigned int i;
+
+	wait_for_completion(sb->go);
+	for (i = 0; i < test_loops && !kthread_should_stop(); i++) {
+		sb->ret = test_submit_one(sb);
+		if (sb->ret)
+			break;
+	}
+	complete(&sb->done);
+
+	set_current_state(TASK_INTERRUPTIBLE);
+	while (!kthread_should_stop()) {
+		schedule();
+		set_current_state(TASK_INTERRUPTIBLE);
+	}
+	__set_current_state(TASK_RUNNING);
+
+	return 0;
+}
+
+/*
+ * Run nr submitters set up by the caller (chan, dst, src, len, cpu) at once and
+ * report them under prefix.  A negative cpu leaves the thread unbound.
+ */
+static int test_submit_run(struct test_rmem_priv *priv, const char *prefix,
+			   struct test_submitter *sbs, unsigned int nr)
+{
+	struct test_stat submit, lat;
+	struct completion go;
+	unsigned int i, started = 0;
+	struct test_submitter *sb;
+	u64 start, elapsed, bytes = 0;
+	char name[32];
+	int ret = 0;
+
+	init_completion(&go);
+	for (i = 0; i < nr; i++) {
+		sb = &sbs[i];
+		sb->go = &go;
+		test_stat_init(&sb->submit);
+		test_stat_init(&sb->lat);
+		init_completion(&sb->done);
+		init_completion(&sb->xfer);
+		sb->cookie = 0;
+		sb->ret = 0;
+		sb->task = kthread_create(test_submit_thread, sb,
+					  "rmem-submit/%u", i);
+		if (IS_ERR(sb->task)) {
+			ret = PTR_ERR(sb->task);
+			break;
+		}
+		if (sb->cpu >= 0)
+			kthread_bind(sb->task, sb->cpu);
+		wake_up_process(sb->task);
+		started++;
+	}
+
+	start = ktime_get_ns();
+	complete_all(&go);
+	for (i = 0; i < started; i++)
+		wait_for_completion(&sbs[i].done);
+	elapsed = max(ktime_get_ns() - start, 1ULL);
+
+	/*
+	 * A timed out descriptor may still be queued on a channel.  Public
+	 * channels carry other users' descriptors too, so only wait for our
+	 * own there instead of terminating everything, unless ours never
+	 * completes: its callback would then complete sb->xfer after sbs
+	 * is freed.
+	 */
+	for (i = 0; i < started; i++) {
+		sb = &sbs[i];
+		kthread_stop(sb->task);
+		if (!sb->chan_public) {
+			dmaengine_terminate_sync(sb->chan);
+		} else if (sb->cookie > 0 &&
+			   dma_sync_wait(sb->chan, sb->cookie) != DMA_COMPLETE) {
+			dev_warn(priv->dev, "%s: copy on %s never completed, terminating\n",
+				 prefix, dma_chan_name(sb->chan));
+			dmaengine_terminate_sync(sb->chan);
+		}
+	}
+
+	if (ret)
+		return ret;
+
+	test_stat_init(&submit);
+	test_stat_init(&lat);
+	for (i = 0; i < nr; i++) {
+		sb = &sbs[i];
+		if (sb->ret && !ret)
+			ret = sb->ret;
+		test_stat_merge(&submit, &sb->submit);
+		test_stat_merge(&lat, &sb->lat);
+		bytes += (u64)sb->lat.n * sb->len;
+		dev_info(priv->dev, "%s/%u %s: %u ops %llu MB/s\n", prefix, i,
+			 dma_chan_name(sb->chan), sb->lat.n, sb->lat.sum ?
+			 div64_u64((u64)sb->lat.n * sb->len * 1000, sb->lat.sum) : 0);
+	}
+
+	snprintf(name, sizeof(name), "%s prep+submit", prefix);
+	test_stat_report(priv, name, sbs[0].len, &submit);
+	snprintf(name, sizeof(name), "%s latency", prefix);
+	test_stat_report(priv, name, sbs[0].len, &lat);
+	dev_info(priv->dev, "%s: total %llu MB/s\n", prefix,
+		 div64_u64(bytes * 1000, elapsed));
+
+	return ret;
+}
+
+static int test_rmem_submit(struct test_rmem_priv *priv)
+{
+	unsigned int i, nr, max_nr = clamp_t(unsigned int, submit_threads, 1, 64);
+	struct test_submitter *sbs;
+	struct test_chan_map m;
+	char prefix[16];
+	size_t slice;
+	int ret;
+
+	if (priv->chan_slave) {
+		dev_info(priv->dev, "SUBMIT: needs a memcpy channel\n");
+		return 0;
+	}
+
+	/* every N uses the same slice size, so the results compare */
+	slice = ALIGN_DOWN(priv->len / max_nr, 64);
+	if (!slice) {
+		dev_err(priv->dev, "SUBMIT: buffer too small for %u submitters\n",
+			max_nr);
+		return -EINVAL;
+	}
+
+	sbs = kcalloc(max_nr, sizeof(*sbs), GFP_KERNEL);
+	if (!sbs)
+		return -ENOMEM;
+
+	test_memory_init(priv->src_addr, priv->fixmem_addr, priv->dst_addr,
+			 priv->len);
+
+	ret = test_chan_map(priv, &m, priv->chan);
+	if (ret) {
+		dev_err(priv->dev, "Failed to map buffers (%d)\n", ret);
+		goto out_free;
+	}
+
+	for (nr = 1; !ret; nr = min(nr * 2, max_nr)) {
+		for (i = 0; i < nr; i++) {
+			sbs[i].chan = priv->chan;
+			sbs[i].dst = m.fix + i * slice;
+			sbs[i].src = m.src + i * slice;
+			sbs[i].len = slice;
+			sbs[i].cpu = -1;
+		}
+		snprintf(prefix, sizeof(prefix), "SUBMIT x%u", nr);
+		ret = test_submit_run(priv, prefix, sbs, nr);
+		if (nr == max_nr)
+			break;
+	}
+
+	test_chan_unmap(priv, &m);
+out_free:
+	kfree(sbs);
+
+	return ret;
+}
+
+/*
+ * One submitter per online CPU on the channel the dmaengine core assigns
+ * to that CPU in its public channel table, against the same threads all
+ * sharing the exclusive channel.  The table only holds channels nobody
+ * requested privately, so priv->chan is never in it.
+ */
+static long test_percpu_find(void *arg)
+{
+	struct dma_chan **chan = arg;
+
+	*chan = dma_find_channel(DMA_MEMCPY);
+
+	return 0;
+}
+
+static int test_rmem_percpu(struct test_rmem_priv *priv)
+{
+	unsigned int i, j, nr, nr_maps = 0;
+	struct test_chan_map *maps, shared;
+	struct test_submitter *sbs;
+	struct dma_chan *chan;
+	struct device *dev;
+	size_t slice;
+	int cpu, ret = 0;
+
+	if (priv->chan_slave) {
+		dev_info(priv->dev, "PERCPU: needs a memcpy channel\n");
+		return 0;
+	}
+
+	nr = min(num_online_cpus(), percpu_threads ?: num_online_cpus());
+	slice = ALIGN_DOWN(priv->len / nr, 64);
+	if (!slice) {
+		dev_err(priv->dev, "PERCPU: buffer too small for %u threads\n",
+			nr);
+		return -EINVAL;
+	}
+
+	sbs = kcalloc(nr, sizeof(*sbs), GFP_KERNEL);
+	maps = kcalloc(nr, sizeof(*maps), GFP_KERNEL);
+	if (!sbs || !maps) {
+		ret = -ENOMEM;
+		goto out_free;
+	}
+
+	test_memory_init(priv->src_addr, priv->fixmem_addr, priv->dst_addr,
+			 priv->len);
+
+	dmaengine_get();
+
+	i = 0;
+	for_each_online_cpu(cpu) {
+		if (i == nr)
+			break;
+		/* the table is per CPU, so look it up from the CPU itself */
+		work_on_cpu(cpu, test_percpu_find, &chan);
+		if (!chan) {
+			dev_info(priv->dev, "PERCPU: no public memcpy channel for cpu%d\n",
+				 cpu);
+			goto out_unmap;
+		}
+
+		/* map the buffers once per DMA device */
+		dev = dmaengine_get_dma_device(chan);
+		for (j = 0; j < nr_maps && maps[j].dev != dev; j++)
+			;
+		if (j == nr_maps) {
+			ret = test_chan_map(priv, &maps[j], chan);
+			if (ret) {
+				dev_err(priv->dev, "Failed to map buffers (%d)\n",
+					ret);
+				goto out_unmap;
+			}
+			nr_maps++;
+		}
+
+		sbs[i].chan = chan;
+		sbs[i].chan_public = true;
+		sbs[i].dst = maps[j].fix + i * slice;
+		sbs[i].src = maps[j].src + i * slice;
+		sbs[i].len = slice;
+		sbs[i].cpu = cpu;
+		i++;
+	}
+
+	ret = test_submit_run(priv, "PERCPU own", sbs, nr);
+	if (ret)
+		goto out_unmap;
+
+	ret = test_chan_map(priv, &shared, priv->chan);
+	if (ret) {
+		dev_err(priv->dev, "Failed to map buffers (%d)\n", ret);
+		goto out_unmap;
+	}
+	for (i = 0; i < nr; i++) {
+		sbs[i].chan = priv->chan;
+		sbs[i].chan_public = false;
+		sbs[i].dst = shared.fix + i * slice;
+		sbs[i].src = shared.src + i * slice;
+	}
+	ret = test_submit_run(priv, "PERCPU shared", sbs, nr);
+	test_chan_unmap(priv, &shared);
+
+out_unmap:
+	for (j = 0; j < nr_maps; j++)
+		test_chan_unmap(priv, &maps[j]);
+	dmaengine_put();
+out_free:
+	kfree(maps);
+	kfree(sbs);
+
+	return ret;
+}
+
+/*
+ * CPU scans of the whole reserved region through a 4 KiB mapping
+ * (vmap_pfn) and through memremap, which uses PMD/PUD block mappings when
+ * the region is aligned for them.  Both are write-combined like fixmem
+ * and only read, so the calibration record and the pool are untouched.
+ * dTLB read misses come from a kernel perf counter when the PMU has one.
+ */
+struct test_huge_map {
+	const char *name;
+	void *addr;
+};
+
+static struct perf_event *test_tlb_counter(void)
+{
+	struct perf_event_attr attr = {
+		.type = PERF_TYPE_HW_CACHE,
+		.size = sizeof(attr),
+		.config = PERF_COUNT_HW_CACHE_DTLB |
+			  (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+			  (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+		.exclude_user = 1,
+	};
+	struct perf_event *event;
+
+	event = perf_event_create_kernel_counter(&attr, -1, current, NULL, NULL);
+
+	return IS_ERR(event) ? NULL : event;
+}
+
+static u64 test_tlb_read(struct perf_event *event)
+{
+	u64 enabled, running;
+
+	return event ? perf_event_read_value(event, &enabled, &running) : 0;
+}
+
+static void test_huge_scan(const void *base, size_t size, bool random)
+{
+	struct rnd_state rnd;
+	size_t i, nr = size / PAGE_SIZE, off;
+
+	if (!random) {
+		for (i = 0; i < size / sizeof(u64); i++)
+			(void)READ_ONCE(((const u64 *)base)[i]);
+		return;
+	}
+
+	/* one word from a random page per access, as many accesses as pages */
+	prandom_seed_state(&rnd, 0x52484d54);
+	for (i = 0; i < nr; i++) {
+		off = (prandom_u32_state(&rnd) % nr) * PAGE_SIZE +
+		      (prandom_u32_state(&rnd) % (PAGE_SIZE / sizeof(u64))) *
+		      sizeof(u64);
+		(void)READ_ONCE(*(const u64 *)(base + off));
+	}
+}
+
+static void test_huge_bench(struct test_rmem_priv *priv,
+			    const struct test_huge_map *map, size_t size,
+			    bool random)
+{
+	struct perf_event *tlb = test_tlb_counter();
+	u64 t0, misses = 0;
+	struct test_stat st;
+	unsigned int i;
+	char name[32];
+
+	test_stat_init(&st);
+	for (i = 0; i < max(huge_loops, 1U); i++) {
+		misses -= test_tlb_read(tlb);
+		t0 = test_time_now(priv);
+		test_huge_scan(map->addr, size, random);
+		test_time_add(priv, &st, t0, 1);
+		misses += test_tlb_read(tlb);
+	}
+	if (tlb)
+		perf_event_release_kernel(tlb);
+
+	/* random scans touch size / PAGE_SIZE words, report bytes moved */
+	snprintf(name, sizeof(name), "HUGE %s %s", random ? "rand" : "seq",
+		 map->name);
+	test_stat_report(priv, name, random ? size / PAGE_SIZE * sizeof(u64) :
+			 size, &st);
+	if (tlb)
+		dev_info(priv->dev, "%s: %llu dTLB misses per scan\n", name,
+			 div_u64(misses, st.n));
+	else
+		dev_info(priv->dev, "%s: no dTLB counter\n", name);
+}
+
+/*
+ * Map the region with 4k PTEs.  vmap_pfn() refuses pfns that have a
+ * struct page, which no-map carve-outs do on some architectures, so those
+ * are mapped by page.  *why says what went wrong when NULL is returned.
+ */
+static void *test_huge_vmap_4k(phys_addr_t base, size_t size,
+			       const char **why)
+{
+	unsigned int i, nr = size >> PAGE_SHIFT;
+	struct page **pages;
+	void *addr;
+
+	if (!pfn_valid(PHYS_PFN(base))) {
+#ifdef CONFIG_VMAP_PFN
+		unsigned long *pfns;
+
+		*why = "vmap_pfn failed";
+		pfns = kvmalloc_array(nr, sizeof(*pfns), GFP_KERNEL);
+		if (!pfns)
+			return NULL;
+		for (i = 0; i < nr; i++)
+			pfns[i] = PHYS_PFN(base) + i;
+		addr = vmap_pfn(pfns, nr, pgprot_writecombine(PAGE_KERNEL));
+		kvfree(pfns);
+
+		return addr;
+#else
+		*why = "no struct pages and no CONFIG_VMAP_PFN";
+		return NULL;
+#endif
+	}
+
+	*why = "vmap failed";
+	pages = kvmalloc_array(nr, sizeof(*pages), GFP_KERNEL);
+	if (!pages)
+		return NULL;
+	for (i = 0; i < nr; i++)
+		pages[i] = pfn_to_page(PHYS_PFN(base) + i);
+	addr = vmap(pages, nr, VM_MAP, pgprot_writecombine(PAGE_KERNEL));
+	kvfree(pages);
+
+	return addr;
+}
+
+static int test_rmem_huge(struct test_rmem_priv *priv)
+{
+	struct test_huge_map maps[2] = {
+		{ .name = "4k" },
+		{ .name = "huge" },
+	};
+	const char *why = NULL;
+	phys_addr_t base;
+	size_t size;
+	int i;
+
+	if (!priv->rmem) {
+		dev_info(priv->dev, "HUGE: needs the reserved-memory region\n");
+		return 0;
+	}
+	base = priv->rmem->base;
+	size = priv->rmem->size;
+
+	maps[0].addr = test_huge_vmap_4k(base, size, &why);
+	if (!maps[0].addr)
+		dev_info(priv->dev, "HUGE: no 4k mapping (%s)\n", why);
+	maps[1].addr = memremap(base, size, MEMREMAP_WC);
+	if (!maps[1].addr)
+		dev_err(priv->dev, "HUGE: failed to memremap %pa\n", &base);
+
+	for (i = 0; i < ARRAY_SIZE(maps); i++) {
+		if (!maps[i].addr)
+			continue;
+		test_huge_bench(priv, &maps[i], size, false);
+		test_huge_bench(priv, &maps[i], size, true);
+	}
+
+	if (maps[1].addr)
+		memunmap(maps[1].addr);
+	if (maps[0].addr)
+		vunmap(maps[0].addr);
+
+	return 0;
+}
+
+/*
+ * Fenced copy jobs.  A job is a memcpy DMA between src/dst and fixmem whose
+ * completion signals a dma_fence from the descriptor callback, so whoever
+ * holds the fence (or a sync_file of it) is woken without the submitter.
+ * Jobs in flight are listed; the tests drain them before terminating the
+ * channel, and jobs that never complete are cancelled with an error.
+ * sync_file fds can outlive priv and the module, so each fence carries its
+ * own lock and holds a module reference until it is freed.
+ */
+#define TEST_FENCE_TIMEOUT_MS	3000
+
+#if IS_ENABLED(CONFIG_SYNC_FILE)
+
+struct test_fence_job {
+	struct dma_fence base;
+	spinlock_t lock;
+	struct test_rmem_priv *priv;
+	struct list_head node;
+	dma_addr_t buf;
+	size_t off;
+	size_t len;
+	enum dma_data_direction dir;
+	u64 submit_ns;
+	u64 signal_ns;
+};
+
+static const char *test_fence_driver_name(struct dma_fence *fence)
+{
+	return KBUILD_MODNAME;
+}
+
+static const char *test_fence_timeline_name(struct dma_fence *fence)
+{
+	return "copy";
+}
+
+static void test_fence_release(struct dma_fence *fence)
+{
+	dma_fence_free(fence);
+	module_put(THIS_MODULE);
+}
+
+static const struct dma_fence_ops test_fence_ops = {
+	.get_driver_name = test_fence_driver_name,
+	.get_timeline_name = test_fence_timeline_name,
+	.release = test_fence_release,
+};
+
+static void test_fence_finish(struct test_fence_job *job, int err)
+{
+	struct test_rmem_priv *priv = job->priv;
+
+	dma_unmap_single(priv->chan_dev, job->buf, job->len, job->dir);
+	/* the scrubber stays off fixmem until fence_inflight drops to 0 */
+	if (job->dir == DMA_TO_DEVICE)
+		test_scrub_invalidate(priv, job->off, job->len);
+	if (err)
+		dma_fence_set_error(&job->base, err);
+	job->signal_ns = ktime_get_ns();
+	test_telem_account(priv, TEST_ENG_DMA, job->dir == DMA_TO_DEVICE ?
+			   TEST_DIR_TO_FIX : TEST_DIR_FROM_FIX, job->len,
+			   job->signal_ns - job->submit_ns, err);
+	dma_fence_signal(&job->base);
+	dma_fence_put(&job->base);
+
+	if (atomic_dec_and_test(&priv->fence_inflight))
+		wake_up_all(&priv->fence_wq);
+}
+
+static void test_fence_callback(void *param)
+{
+	struct test_fence_job *job = param;
+	struct test_rmem_priv *priv = job->priv;
+	unsigned long flags;
+	bool mine;
+
+	spin_lock_irqsave(&priv->fence_lock, flags);
+	mine = !list_empty(&job->node);
+	list_del_init(&job->node);
+	spin_unlock_irqrestore(&priv->fence_lock, flags);
+
+	if (mine)
+		test_fence_finish(job, 0);
+}
+
+/*
+ * Queue a copy of len bytes at off, into fixmem when to_fix is set and out
+ * of it otherwise, and return its fence with a reference for the caller.
+ * Called with priv->lock held.
+ */
+static struct dma_fence *test_fence_submit(struct test_rmem_priv *priv,
+					   bool to_fix, size_t off, size_t len)
+{
+	struct test_fence_job *job;
+	struct dma_async_tx_descriptor *tx;
+	dma_addr_t fix = priv->fixmem_paddr + off;
+	unsigned long flags;
+	dma_cookie_t cookie;
+	void *buf;
+	int ret;
+
+	if (priv->chan_slave)
+		return ERR_PTR(-EOPNOTSUPP);
+	if (!len || off > priv->len || len > priv->len - off)
+		return ERR_PTR(-EINVAL);
+
+	job = kzalloc(sizeof(*job), GFP_KERNEL);
+	if (!job)
+		return ERR_PTR(-ENOMEM);
+
+	job->priv = priv;
+	job->off = off;
+	job->len = len;
+	job->dir = to_fix ? DMA_TO_DEVICE : DMA_FROM_DEVICE;
+	INIT_LIST_HEAD(&job->node);
+	spin_lock_init(&job->lock);
+	dma_fence_init(&job->base, &test_fence_ops, &job->lock,
+		       priv->fence_ctx, ++priv->fence_seqno);
+	/* dropped by test_fence_release() */
+	__module_get(THIS_MODULE);
+
+	buf = (to_fix ? priv->src_addr : priv->dst_addr) + off;
+	job->buf = dma_map_single(priv->chan_dev, buf, len, job->dir);
+	ret = dma_mapping_error(priv->chan_dev, job->buf);
+	if (ret)
+		goto err_put;
+
+	tx = to_fix ?
+	     dmaengine_prep_dma_memcpy(priv->chan, fix, job->buf, len,
+				       DMA_PREP_INTERRUPT | DMA_CTRL_ACK) :
+	     dmaengine_prep_dma_memcpy(priv->chan, job->buf, fix, len,
+				       DMA_PREP_INTERRUPT | DMA_CTRL_ACK);
+	if (!tx) {
+		ret = -ENOMEM;
+		goto err_unmap;
+	}
+	tx->callback = test_fence_callback;
+	tx->callback_param = job;
+
+	/* one reference for the job, dropped when it signals */
+	dma_fence_get(&job->base);
+	atomic_inc(&priv->fence_inflight);
+	spin_lock_irqsave(&priv->fence_lock, flags);
+	list_add_tail(&job->node, &priv->fence_jobs);
+	spin_unlock_irqrestore(&priv->fence_lock, flags);
+
+	job->submit_ns = ktime_get_ns();
+	cookie = dmaengine_submit(tx);
+	if (dma_submit_error(cookie)) {
+		spin_lock_irqsave(&priv->fence_lock, flags);
+		list_del_init(&job->node);
+		spin_unlock_irqrestore(&priv->fence_lock, flags);
+		test_fence_finish(job, -EIO);
+		return &job->base;
+	}
+	dma_async_issue_pending(priv->chan);
+
+	return &job->base;
+
+err_unmap:
+	dma_unmap_single(priv->chan_dev, job->buf, len, job->dir);
+err_put:
+	dma_fence_put(&job->base);
+
+	return ERR_PTR(ret);
+}
+
+/* wait for the jobs in flight, cancelling them after timeout_ms */
+static void test_fence_drain(struct test_rmem_priv *priv,
+			     unsigned int timeout_ms)
+{
+	struct test_fence_job *job, *tmp;
+	unsigned long flags;
+	LIST_HEAD(jobs);
+
+	if (wait_event_timeout(priv->fence_wq,
+			       !atomic_read(&priv->fence_inflight),
+			       msecs_to_jiffies(timeout_ms)))
+		return;
+
+	dev_warn(priv->dev, "FENCE: cancelling %d jobs in flight\n",
+		 atomic_read(&priv->fence_inflight));
+	dmaengine_terminate_sync(priv->chan);
+
+	spin_lock_irqsave(&priv->fence_lock, flags);
+	list_splice_init(&priv->fence_jobs, &jobs);
+	spin_unlock_irqrestore(&priv->fence_lock, flags);
+
+	list_for_each_entry_safe(job, tmp, &jobs, node) {
+		list_del_init(&job->node);
+		test_fence_finish(job, -ECANCELED);
+	}
+}
+
+static void test_fence_init(struct test_rmem_priv *priv)
+{
+	spin_lock_init(&priv->fence_lock);
+	INIT_LIST_HEAD(&priv->fence_jobs);
+	init_waitqueue_head(&priv->fence_wq);
+	atomic_set(&priv->fence_inflight, 0);
+	priv->fence_ctx = dma_fence_context_alloc(1);
+}
+
+/*
+ * Fence signal latency: submit->signal is the copy as seen by the
+ * callback, signal->wake is what a waiter on the fence pays on top.
+ */
+static int test_rmem_fence(struct test_rmem_priv *priv)
+{
+	struct test_stat sig, wake;
+	struct test_fence_job *job;
+	struct dma_fence *fence;
+	unsigned int i;
+	long ret = 0;
+	u64 t0, t1;
+
+	if (priv->chan_slave) {
+		dev_info(priv->dev, "FENCE: needs a memcpy channel\n");
+		return 0;
+	}
+
+	test_memory_init(priv->src_addr, priv->fixmem_addr, priv->dst_addr,
+			 priv->len);
+
+	test_stat_init(&sig);
+	test_stat_init(&wake);
+	for (i = 0; i < test_loops; i++) {
+		t0 = ktime_get_ns();
+		fence = test_fence_submit(priv, !(i & 1), 0, priv->len);
+		if (IS_ERR(fence))
+			return PTR_ERR(fence);
+
+		ret = dma_fence_wait_timeout(fence, false,
+				msecs_to_jiffies(TEST_FENCE_TIMEOUT_MS));
+		t1 = ktime_get_ns();
+		job = container_of(fence, struct test_fence_job, base);
+		if (!ret)
+			ret = -ETIMEDOUT;
+		else if (ret > 0)
+			ret = fence->error;
+		if (!ret) {
+			test_stat_add(&sig, job->signal_ns - t0);
+			test_stat_add(&wake, t1 - job->signal_ns);
+		}
+		dma_fence_put(fence);
+		if (ret)
+			break;
+	}
+	test_fence_drain(priv, TEST_FENCE_TIMEOUT_MS);
+
+	test_stat_report(priv, "FENCE submit->signal", priv->len, &sig);
+	test_stat_report(priv, "FENCE signal->wake", priv->len, &wake);
+
+	return ret;
+}
+#else
+static void test_fence_drain(struct test_rmem_priv *priv,
+			     unsigned int timeout_ms)
+{
+}
+
+static void test_fence_init(struct test_rmem_priv *priv)
+{
+}
+
+static int test_rmem_fence(struct test_rmem_priv *priv)
+{
+	dev_info(priv->dev, "FENCE: needs CONFIG_SYNC_FILE\n");
+
+	return 0;
+}
+#endif /* CONFIG_SYNC_FILE */
+
+/*
+ * Dependent chains src->fix->dst(->fix->dst...) of async_chain legs.  The
+ * serial path waits for every leg like the DMA test does; the chained path
+ * queues all legs at once, fenced so each starts after the previous one,
+ * with a single completion callback on the last; async_tx does the same
+ * through depend_tx and falls back to the CPU when it finds no channel.
+ */
+static dma_addr_t test_chain_leg(dma_addr_t dst, dma_addr_t fix,
+				 unsigned int k)
+{
+	return k & 1 ? dst : fix;
+}
+
+static int test_chain_serial(struct test_rmem_priv *priv, dma_addr_t src,
+			     dma_addr_t dst, unsigned int depth)
+{
+	dma_addr_t from = src, to;
+	unsigned int k;
+	int ret;
+
+	for (k = 0; k < depth; k++, from = to) {
+		to = test_chain_leg(dst, priv->fixmem_paddr, k);
+		ret = test_memcpy_dma(priv->chan, to, from, priv->len);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+static int test_chain_queued(struct test_rmem_priv *priv, dma_addr_t src,
+			     dma_addr_t dst, unsigned int depth)
+{
+	struct dma_async_tx_descriptor *tx;
+	struct dma_chan *chan = priv->chan;
+	void *from_cpu = priv->src_addr, *to_cpu;
+	dma_addr_t from = src, to;
+	struct completion done;
+	unsigned int k;
+	int ret = 0;
+
+	/* no memcpy channel, run the same legs on the CPU */
+	if (priv->chan_slave) {
+		for (k = 0; k < depth; k++, from_cpu = to_cpu) {
+			to_cpu = k & 1 ? priv->dst_addr : priv->fixmem_addr;
+			memcpy(to_cpu, from_cpu, priv->len);
+		}
+		return 0;
+	}
+
+	init_completion(&done);
+	for (k = 0; k < depth; k++, from = to) {
+		to = test_chain_leg(dst, priv->fixmem_paddr, k);
+		tx = dmaengine_prep_dma_memcpy(chan, to, from, priv->len,
+					       k == depth - 1 ?
+					       DMA_PREP_INTERRUPT | DMA_CTRL_ACK :
+					       DMA_PREP_FENCE | DMA_CTRL_ACK);
+		if (!tx) {
+			ret = -ENOMEM;
+			goto out_terminate;
+		}
+		if (k == depth - 1) {
+			tx->callback = test_submit_callback;
+			tx->callback_param = &done;
+		}
+		if (dma_submit_error(dmaengine_submit(tx))) {
+			ret = -EINVAL;
+			goto out_terminate;
+		}
+	}
+	dma_async_issue_pending(chan);
+
+	if (!wait_for_completion_timeout(&done,
+				msecs_to_jiffies(TEST_SUBMIT_TIMEOUT_MS)))
+		ret = -ETIMEDOUT;
+
+out_terminate:
+	if (ret)
+		dmaengine_terminate_sync(chan);
+
+	return ret;
+}
+
+#if IS_ENABLED(CONFIG_ASYNC_MEMCPY)
+/* returns 1 when async_tx ran the chain on a channel, 0 on the CPU */
+static int test_chain_async_tx(struct test_rmem_priv *priv, unsigned int depth)
+{
+	struct page *fix = pfn_to_page(PHYS_PFN(priv->fixmem_phys));
+	struct page *src = virt_to_page(priv->src_addr);
+	struct page *dst = virt_to_page(priv->dst_addr);
+	unsigned int fix_off = offset_in_page(priv->fixmem_phys);
+	unsigned int src_off = offset_in_page(priv->src_addr);
+	unsigned int dst_off = offset_in_page(priv->dst_addr);
+	struct dma_async_tx_descriptor *tx = NULL;
+	struct async_submit_ctl submit;
+	struct completion done;
+	unsigned int k;
+	bool last;
+
+	init_completion(&done);
+	for (k = 0; k < depth; k++) {
+		last = k == depth - 1;
+		/* intermediate legs stay un-acked until a dependent attaches */
+		init_async_submit(&submit, last ? ASYNC_TX_ACK : 0, tx,
+				  last ? test_submit_callback : NULL,
+				  last ? &done : NULL, NULL);
+		if (k & 1)
+			tx = async_memcpy(dst, fix, dst_off, fix_off, priv->len,
+					  &submit);
+		else
+			tx = async_memcpy(fix, k ? dst : src, fix_off,
+					  k ? dst_off : src_off, priv->len,
+					  &submit);
+	}
+	async_tx_issue_pending_all();
+
+	if (!wait_for_completion_timeout(&done,
+				msecs_to_jiffies(TEST_SUBMIT_TIMEOUT_MS)))
+		return -ETIMEDOUT;
+
+	return tx ? 1 : 0;
+}
+#endif
+
+#if IS_ENABLED(CONFIG_ASYNC_MEMCPY)
+/*
+ * async_tx reaches fixmem through page_address() for the CPU fallback and
+ * for cache maintenance, so it needs the linear map.  pfn_valid() alone
+ * does not say so: arm64 has struct pages for no-map memory too, but that
+ * memory is not registered as System RAM.
+ */
+static bool test_chain_linear(struct test_rmem_priv *priv)
+{
+	unsigned long pfn = PHYS_PFN(priv->fixmem_phys);
+	unsigned long last = PHYS_PFN(priv->fixmem_phys + priv->len - 1);
+
+	for (; pfn <= last; pfn++)
+		if (!pfn_valid(pfn) || !page_is_ram(pfn))
+			return false;
+
+	return true;
+}
+#endif
+
+static void test_chain_check(struct test_rmem_priv *priv, const char *name)
+{
+	bool ok = !memcmp(priv->src_addr, priv->dst_addr, priv->len);
+
+	dev_info(priv->dev, "%s: %s\n", name, ok ? "OK" : "NG");
+}
+
+static int test_rmem_async(struct test_rmem_priv *priv)
+{
+	unsigned int i, depth = max(async_chain & ~1U, 2U);
+	struct device *chan_dev = priv->chan_dev;
+	dma_addr_t src = 0, dst = 0;
+	struct test_stat st;
+	char name[32];
+	u64 t0;
+	int ret = 0;
+
+	test_memory_init(priv->src_addr, priv->fixmem_addr, priv->dst_addr,
+			 priv->len);
+
+	if (!priv->chan_slave) {
+		src = dma_map_single(chan_dev, priv->src_addr, priv->len,
+				     DMA_TO_DEVICE);
+		ret = dma_mapping_error(chan_dev, src);
+		if (ret)
+			goto out_err;
+		/* dst is also a source for chains longer than two legs */
+		dst = dma_map_single(chan_dev, priv->dst_addr, priv->len,
+				     DMA_BIDIRECTIONAL);
+		ret = dma_mapping_error(chan_dev, dst);
+		if (ret) {
+			dma_unmap_single(chan_dev, src, priv->len, DMA_TO_DEVICE);
+			goto out_err;
+		}
+
+		test_stat_init(&st);
+		for (i = 0; i < test_loops && !ret; i++) {
+			t0 = test_time_now(priv);
+			ret = test_chain_serial(priv, src, dst, depth);
+			if (!ret)
+				test_time_add(priv, &st, t0, 1);
+		}
+		snprintf(name, sizeof(name), "ASYNC x%u serial", depth);
+		test_stat_report(priv, name, priv->len, &st);
+
+		dma_sync_single_for_cpu(chan_dev, dst, priv->len,
+					DMA_BIDIRECTIONAL);
+		test_chain_check(priv, name);
+		memset(priv->dst_addr, 0, priv->len);
+		dma_sync_single_for_device(chan_dev, dst, priv->len,
+					   DMA_BIDIRECTIONAL);
+	}
+
+	test_stat_init(&st);
+	for (i = 0; i < test_loops && !ret; i++) {
+		t0 = test_time_now(priv);
+		ret = test_chain_queued(priv, src, dst, depth);
+		if (!ret)
+			test_time_add(priv, &st, t0, 1);
+	}
+	snprintf(name, sizeof(name), "ASYNC x%u chain%s", depth,
+		 priv->chan_slave ? " cpu" : "");
+
+	if (!priv->chan_slave) {
+		dma_unmap_single(chan_dev, dst, priv->len, DMA_BIDIRECTIONAL);
+		dma_unmap_single(chan_dev, src, priv->len, DMA_TO_DEVICE);
+	}
+	test_stat_report(priv, name, priv->len, &st);
+	test_chain_check(priv, name);
+	if (ret)
+		return ret;
+
+#if IS_ENABLED(CONFIG_ASYNC_MEMCPY)
+	if (!test_chain_linear(priv)) {
+		dev_info(priv->dev, "ASYNC: fixmem is not in the linear map, no async_tx\n");
+		return 0;
+	}
+
+	memset(priv->dst_addr, 0, priv->len);
+	test_stat_init(&st);
+	for (i = 0; i < test_loops; i++) {
+		t0 = test_time_now(priv);
+		ret = test_chain_async_tx(priv, depth);
+		if (ret < 0)
+			return ret;
+		test_time_add(priv, &st, t0, 1);
+	}
+	snprintf(name, sizeof(name), "ASYNC x%u async_tx %s", depth,
+		 ret ? "dma" : "cpu");
+	test_stat_report(priv, name, priv->len, &st);
+	test_chain_check(priv, name);
+#endif
+
+	return 0;
+
+out_err:
+	dev_err(priv->dev, "Failed to map buffers (%d)\n", ret);
+
+	return ret;
+}
+
+/*
+ * First transfer after an idle gap against back-to-back transfers, to see
+ * what autosuspend of the DMA controller costs.  In the hold variant a
+ * runtime PM reference is taken at the start of each burst and dropped at
+ * its end, so the resume moves into the get and the burst runs awake.
+ */
+static int test_pm_burst(struct test_rmem_priv *priv, dma_addr_t src,
+			 size_t len, bool hold, struct test_stat *first,
+			 struct test_stat *b2b)
+{
+	struct device *dma_dev = dmaengine_get_dma_device(priv->chan);
+	unsigned int i;
+	int ret;
+	u64 t0;
+
+	t0 = test_time_now(priv);
+	if (hold) {
+		ret = pm_runtime_resume_and_get(dma_dev);
+		if (ret < 0)
+			return ret;
+	}
+
+	for (i = 0; i < max(pm_burst, 1U); i++) {
+		if (i)
+			t0 = test_time_now(priv);
+		ret = test_memcpy_dma(priv->chan, priv->fixmem_paddr, src, len);
+		if (ret)
+			break;
+		test_time_add(priv, i ? b2b : first, t0, 1);
+	}
+
+	if (hold) {
+		pm_runtime_mark_last_busy(dma_dev);
+		pm_runtime_put_autosuspend(dma_dev);
+	}
+
+	return ret;
+}
+
+static int test_pm_gap(struct test_rmem_priv *priv, dma_addr_t src,
+		       size_t len, unsigned int gap_ms, bool hold)
+{
+	struct test_stat first, b2b;
+	const char *mode = hold ? " hold" : "";
+	unsigned int i;
+	char name[32];
+	int ret = 0;
+
+	test_stat_init(&first);
+	test_stat_init(&b2b);
+	for (i = 0; i < max(pm_bursts, 1U) && !ret; i++) {
+		msleep(gap_ms);
+		ret = test_pm_burst(priv, src, len, hold, &first, &b2b);
+	}
+
+	snprintf(name, sizeof(name), "PM %ums%s first", gap_ms, mode);
+	test_stat_report(priv, name, len, &first);
+	snprintf(name, sizeof(name), "PM %ums%s b2b", gap_ms, mode);
+	test_stat_report(priv, name, len, &b2b);
+
+	return ret;
+}
+
+static int test_rmem_pm(struct test_rmem_priv *priv)
+{
+	struct device *chan_dev = priv->chan_dev;
+	size_t len = min_t(size_t, priv->len, SZ_4K);
+	struct device *dma_dev;
+	dma_addr_t src;
+	unsigned int i;
+	int ret;
+
+	if (priv->chan_slave) {
+		dev_info(priv->dev, "PM: needs a memcpy channel\n");
+		return 0;
+	}
+
+	dma_dev = dmaengine_get_dma_device(priv->chan);
+	dev_info(priv->dev, "PM: %s runtime PM %s\n", dev_name(dma_dev),
+		 pm_runtime_enabled(dma_dev) ? "enabled" : "disabled");
+
+	test_memory_init(priv->src_addr, priv->fixmem_addr, priv->dst_addr,
+			 priv->len);
+
+	src = dma_map_single(chan_dev, priv->src_addr, len, DMA_TO_DEVICE);
+	ret = dma_mapping_error(chan_dev, src);
+	if (ret) {
+		dev_err(priv->dev, "Failed to map src (%d)\n", ret);
+		return ret;
+	}
+
+	for (i = 0; i < pm_nr_gaps && !ret; i++) {
+		ret = test_pm_gap(priv, src, len, pm_gaps_ms[i], false);
+		if (!ret)
+			ret = test_pm_gap(priv, src, len, pm_gaps_ms[i], true);
+	}
+
+	dma_unmap_single(chan_dev, src, len, DMA_TO_DEVICE);
+
+	return ret;
+}
+
+/*
+ * Workload replay.  A trace is a sequence of little-endian records of
+ * (size, gap since the previous record in us, direction), loaded from
+ * firmware (replay_fw) or written to debugfs "trace".  Each record is
+ * issued at its arrival time on the DMA channel, or on the CPU with
+ * replay_cpu or without a memcpy channel, and its latency is taken from
+ * the arrival, so falling behind shows up as queueing.  Synthetic bimodal
+ * and Zipf traces are generated with the same record layout.
+ */
+struct test_trace_rec {
+	__le32 size;
+	__le32 gap_us;
+	u8 dir;			/* TEST_IOC_TO_FIX or TEST_IOC_FROM_FIX */
+	u8 pad[3];
+} __packed;
+
+#define TEST_TRACE_MAX_BYTES	(SZ_1M * sizeof(struct test_trace_rec))
+#define TEST_REPLAY_SYNTH_BIMODAL	BIT(0)
+#define TEST_REPLAY_SYNTH_ZIPF		BIT(1)
+#define TEST_REPLAY_SPIN_NS		(50 * NSEC_PER_USEC)
+
+static void test_replay_wait(u64 target)
+{
+	u64 now;
+
+	while ((now = ktime_get_ns()) < target) {
+		if (target - now > TEST_REPLAY_SPIN_NS)
+			usleep_range(div_u64(target - now, NSEC_PER_USEC) - 40,
+				     div_u64(target - now, NSEC_PER_USEC) - 20);
+		else
+			cpu_relax();
+	}
+}
+
+static int test_replay(struct test_rmem_priv *priv, const char *label,
+		       const struct test_trace_rec *recs, size_t nr)
+{
+	bool cpu = replay_cpu || priv->chan_slave;
+	unsigned int hist[TEST_TELEM_BUCKETS] = {};
+	u64 start, arrival, now, t0, bytes = 0;
+	struct test_chan_map m;
+	struct test_stat st;
+	bool to_fix;
+	char name[32];
+	size_t i, len;
+	int ret = 0;
+
+	if (!cpu) {
+		ret = test_chan_map(priv, &m, priv->chan);
+		if (ret) {
+			dev_err(priv->dev, "Failed to map buffers (%d)\n", ret);
+			return ret;
+		}
+	}
+
+	test_stat_init(&st);
+	start = arrival = ktime_get_ns();
+	for (i = 0; i < nr; i++) {
+		len = min_t(size_t, le32_to_cpu(recs[i].size), priv->len);
+		to_fix = recs[i].dir == TEST_IOC_TO_FIX;
+		arrival += (u64)le32_to_cpu(recs[i].gap_us) * NSEC_PER_USEC;
+		if (!len)
+			continue;
+
+		test_replay_wait(arrival);
+		t0 = ktime_get_ns();
+		if (cpu)
+			memcpy(to_fix ? priv->fixmem_addr : priv->dst_addr,
+			       to_fix ? priv->src_addr : priv->fixmem_addr, len);
+		else if (to_fix)
+			ret = test_memcpy_dma(priv->chan, m.fix, m.src, len);
+		else
+			ret = test_memcpy_dma(priv->chan, m.dst, m.fix, len);
+		now = ktime_get_ns();
+		test_telem_account(priv, cpu ? TEST_ENG_CPU : TEST_ENG_DMA,
+				   to_fix ? TEST_DIR_TO_FIX : TEST_DIR_FROM_FIX,
+				   len, now - t0, ret);
+		if (ret)
+			break;
+
+		test_stat_add(&st, now - arrival);
+		hist[test_telem_bucket(now - arrival)]++;
+		bytes += len;
+	}
+	now = ktime_get_ns();
+
+	if (!cpu)
+		test_chan_unmap(priv, &m);
+
+	snprintf(name, sizeof(name), "REPLAY %s %s", label, cpu ? "cpu" : "dma");
+	test_stat_report(priv, name, st.n ? div_u64(bytes, st.n) : 0, &st);
+	test_rt_hist(priv, name, hist);
+	dev_info(priv->dev, "%s: %u copies %llu bytes %llu MB/s\n", name, st.n,
+		 bytes, div64_u64(bytes * 1000, max(now - start, 1ULL)));
+
+	return ret;
+}
+
+/* sizes are powers of two from 64 up to the buffer, rank 1 the smallest */
+static size_t test_replay_zipf(struct rnd_state *rnd, size_t max_len)
+{
+	unsigned int k, nr = 0;
+	u32 total = 0, r;
+	size_t size;
+
+	for (size = 64; size <= max_len; size <<= 1)
+		total += U16_MAX / ++nr;
+	if (!total)
+		return max_len;
+
+	r = prandom_u32_state(rnd) % total;
+	for (k = 1; k < nr; k++) {
+		if (r < U16_MAX / k)
+			break;
+		r -= U16_MAX / k;
+	}
+
+	return (size_t)64 << (k - 1);
+}
+
+static int test_replay_synth(struct test_rmem_priv *priv, unsigned int kind)
+{
+	struct test_trace_rec *recs;
+	struct rnd_state rnd;
+	size_t i, nr = max(replay_count, 1U), size;
+	int ret;
+
+	recs = kvcalloc(nr, sizeof(*recs), GFP_KERNEL);
+	if (!recs)
+		return -ENOMEM;
+
+	prandom_seed_state(&rnd, 0x52504c59);
+	for (i = 0; i < nr; i++) {
+		if (kind == TEST_REPLAY_SYNTH_BIMODAL)
+			/* mostly small control blocks, some full buffers */
+			size = prandom_u32_state(&rnd) % 10 ?
+			       min_t(size_t, SZ_256, priv->len) : priv->len;
+		else
+			size = test_replay_zipf(&rnd, priv->len);
+
+		recs[i].size = cpu_to_le32(size);
+		recs[i].gap_us = cpu_to_le32(replay_gap_us ?
+				prandom_u32_state(&rnd) % (2 * replay_gap_us) : 0);
+		recs[i].dir = prandom_u32_state(&rnd) & 1 ? TEST_IOC_FROM_FIX :
+							     TEST_IOC_TO_FIX;
+	}
+
+	ret = test_replay(priv, kind == TEST_REPLAY_SYNTH_BIMODAL ? "bimodal" :
+			  "zipf", recs, nr);
+	kvfree(recs);
+
+	return ret;
+}
+
+static int test_trace_set(struct test_rmem_priv *priv, const void *data,
+			  size_t bytes)
+{
+	u8 *trace = NULL;
+
+	if (bytes) {
+		trace = kvmalloc(bytes, GFP_KERNEL);
+		if (!trace)
+			return -ENOMEM;
+		memcpy(trace, data, bytes);
+	}
+
+	kvfree(priv->trace);
+	priv->trace = trace;
+	priv->trace_bytes = bytes;
+
+	return 0;
+}
+
+static int test_rmem_replay(struct test_rmem_priv *priv)
+{
+	const struct firmware *fw;
+	int ret = 0;
+
+	test_memory_init(priv->src_addr, priv->fixmem_addr, priv->dst_addr,
+			 priv->len);
+
+	if (replay_fw && *replay_fw) {
+		ret = request_firmware(&fw, replay_fw, priv->dev);
+		if (ret) {
+			dev_err(priv->dev, "REPLAY: failed to load %s (%d)\n",
+				replay_fw, ret);
+			return ret;
+		}
+		if (fw->size > TEST_TRACE_MAX_BYTES)
+			ret = -EFBIG;
+		else
+			ret = test_trace_set(priv, fw->data, fw->size);
+		release_firmware(fw);
+		if (ret)
+			return ret;
+	}
+
+	if (priv->trace_bytes >= sizeof(struct test_trace_rec))
+		ret = test_replay(priv, "trace", (void *)priv->trace,
+				  priv->trace_bytes / sizeof(struct test_trace_rec));
+	if (!ret && (replay_synth & TEST_REPLAY_SYNTH_BIMODAL))
+		ret = test_replay_synth(priv, TEST_REPLAY_SYNTH_BIMODAL);
+	if (!ret && (replay_synth & TEST_REPLAY_SYNTH_ZIPF))
+		ret = test_replay_synth(priv, TEST_REPLAY_SYNTH_ZIPF);
+
+	return ret;
+}
+
+/*
+ * Sampled verification for soak runs.  Each transfer checks about
+ * sample_pct percent of the cache lines of fixmem against src: half of
+ * them a window that moves on by its own length every transfer, so each
+ * line is checked at least once per rotation, and half picked at random
+ * from sample_seed.  The checked lines are restamped in src first, so a
+ * copy that did not land is caught as well.  A last pass flips a byte in
+ * one random line after every copy to measure the detection rate.
+ */
+#define TEST_SAMPLE_LINE	L1_CACHE_BYTES
+
+struct test_sample {
+	struct rnd_state rnd;
+	unsigned long *covered;
+	unsigned int *lines;
+	unsigned int nr_lines;
+	unsigned int nr_win;
+	unsigned int nr;
+	unsigned int win;
+	u32 seq;
+};
+
+static void test_sample_pick(struct test_sample *s, u32 *src)
+{
+	unsigned int i, line;
+
+	s->seq++;
+
+	for (i = 0; i < s->nr; i++) {
+		if (i < s->nr_win)
+			line = (s->win + i) % s->nr_lines;
+		else
+			line = prandom_u32_state(&s->rnd) % s->nr_lines;
+		s->lines[i] = line;
+		src[line * TEST_SAMPLE_LINE / sizeof(u32)] = s->seq ^ line;
+	}
+	s->win = (s->win + s->nr_win) % s->nr_lines;
+}
+
+static unsigned int test_sample_check(struct test_sample *s, const void *src,
+				      const void *fix)
+{
+	unsigned int i, bad = 0;
+	size_t off;
+
+	for (i = 0; i < s->nr; i++) {
+		off = (size_t)s->lines[i] * TEST_SAMPLE_LINE;
+		bad += !!memcmp(fix + off, src + off, TEST_SAMPLE_LINE);
+		set_bit(s->lines[i], s->covered);
+	}
+
+	return bad;
+}
+
+enum test_sample_mode {
+	TEST_SAMPLE_NONE,
+	TEST_SAMPLE_FULL,
+	TEST_SAMPLE_SAMPLED,
+	TEST_SAMPLE_INJECT,
+};
+
+static int test_sample_pass(struct test_rmem_priv *priv, struct test_sample *s,
+			    dma_addr_t src_paddr, enum test_sample_mode mode,
+			    unsigned int *bad)
+{
+	static const char * const names[] = {
+		[TEST_SAMPLE_NONE] = "SAMPLE copy src->fix",
+		[TEST_SAMPLE_FULL] = "SAMPLE copy+full verify src->fix",
+		[TEST_SAMPLE_SAMPLED] = "SAMPLE copy+sampled verify src->fix",
+		[TEST_SAMPLE_INJECT] = "SAMPLE copy+inject+verify src->fix",
+	};
+	struct device *chan_dev = priv->chan_dev;
+	u8 *fix = priv->fixmem_addr;
+	size_t len = priv->len, off;
+	struct test_stat st;
+	unsigned int i;
+	u64 t0, t1;
+	int ret = 0;
+
+	*bad = 0;
+	test_stat_init(&st);
+	for (i = 0; i < test_loops; i++) {
+		t0 = test_time_now(priv);
+		if (mode >= TEST_SAMPLE_SAMPLED)
+			test_sample_pick(s, priv->src_addr);
+		dma_sync_single_for_device(chan_dev, src_paddr, len,
+					   DMA_TO_DEVICE);
+		t1 = ktime_get_ns();
+		if (priv->chan_slave)
+			ret = test_slave_dma(priv->chan, DMA_MEM_TO_DEV,
+					     src_paddr, priv->fixmem_paddr, len);
+		else
+			ret = test_memcpy_dma(priv->chan, priv->fixmem_paddr,
+					      src_paddr, len);
+		test_telem_account(priv, TEST_ENG_DMA, TEST_DIR_TO_FIX, len,
+				   ktime_get_ns() - t1, ret);
+		dma_sync_single_for_cpu(chan_dev, src_paddr, len, DMA_TO_DEVICE);
+		if (ret)
+			break;
+
+		if (mode == TEST_SAMPLE_INJECT) {
+			off = (size_t)(prandom_u32_state(&s->rnd) %
+				       s->nr_lines) * TEST_SAMPLE_LINE;
+			fix[off] ^= 0xff;
+		}
+
+		if (mode == TEST_SAMPLE_FULL)
+			*bad += !!memcmp(fix, priv->src_addr, len);
+		else if (mode >= TEST_SAMPLE_SAMPLED)
+			*bad += !!test_sample_check(s, priv->src_addr, fix);
+		test_time_add(priv, &st, t0, 1);
+	}
+	test_stat_report(priv, names[mode], len, &st);
+
+	return ret;
+}
+
+static int test_rmem_sample(struct test_rmem_priv *priv)
+{
+	struct device *dev = priv->dev;
+	struct device *chan_dev = priv->chan_dev;
+	unsigned int pct = clamp(sample_pct, 1U, 100U);
+	unsigned int bad, covered, rotation;
+	struct test_sample s = {};
+	dma_addr_t src_paddr;
+	int ret = -ENOMEM;
+
+	s.nr_lines = priv->len / TEST_SAMPLE_LINE;
+	if (!s.nr_lines)
+		return -EINVAL;
+	s.nr = max(DIV_ROUND_UP(s.nr_lines * pct, 100), 2U);
+	s.nr = min(s.nr, s.nr_lines);
+	s.nr_win = DIV_ROUND_UP(s.nr, 2);
+	rotation = DIV_ROUND_UP(s.nr_lines, s.nr_win);
+	prandom_seed_state(&s.rnd, sample_seed);
+
+	s.lines = kcalloc(s.nr, sizeof(*s.lines), GFP_KERNEL);
+	s.covered = bitmap_zalloc(s.nr_lines, GFP_KERNEL);
+	if (!s.lines || !s.covered)
+		goto out_free;
+
+	test_memory_init(priv->src_addr, priv->fixmem_addr, priv->dst_addr,
+			 priv->len);
+
+	src_paddr = dma_map_single(chan_dev, priv->src_addr, priv->len,
+				   DMA_TO_DEVICE);
+	ret = dma_mapping_error(chan_dev, src_paddr);
+	if (ret) {
+		dev_err(dev, "Failed to map src (%d)\n", ret);
+		goto out_free;
+	}
+
+	ret = test_sample_pass(priv, &s, src_paddr, TEST_SAMPLE_NONE, &bad);
+	if (ret)
+		goto out_unmap;
+
+	ret = test_sample_pass(priv, &s, src_paddr, TEST_SAMPLE_FULL, &bad);
+	if (ret)
+		goto out_unmap;
+	dev_info(dev, "SAMPLE: full verify %s\n", bad ? "NG" : "OK");
+
+	ret = test_sample_pass(priv, &s, src_paddr, TEST_SAMPLE_SAMPLED, &bad);
+	if (ret)
+		goto out_unmap;
+	covered = bitmap_weight(s.covered, s.nr_lines);
+	dev_info(dev, "SAMPLE: %u of %u lines per transfer (seed %#x), %u transfers per rotation, covered %u/%u lines after %u transfers, %u mismatching transfers %s\n",
+		 s.nr, s.nr_lines, sample_seed, rotation, covered, s.nr_lines,
+		 test_loops, bad, bad ? "NG" : "OK");
+
+	/* one flipped line per transfer, rewritten by the next copy */
+	ret = test_sample_pass(priv, &s, src_paddr, TEST_SAMPLE_INJECT, &bad);
+	if (ret)
+		goto out_unmap;
+	dev_info(dev, "SAMPLE: detection of a single bad line up to %u.%u%%, %u/%u transfers caught\n",
+		 min(s.nr * 1000 / s.nr_lines, 1000U) / 10,
+		 min(s.nr * 1000 / s.nr_lines, 1000U) % 10, bad, test_loops);
+
+out_unmap:
+	dma_unmap_single(chan_dev, src_paddr, priv->len, DMA_TO_DEVICE);
+out_free:
+	bitmap_free(s.covered);
+	kfree(s.lines);
+	if (ret)
+		dev_err(dev, "SAMPLE: failed (%d)\n", ret);
+
+	return ret;
+}
+
+/*
+ * With rmem_node set, the second memory-region is hotplugged as System
+ * RAM of that node, driver managed like dax/kmem, so that unmodified
+ * applications can be bound to it with numactl once its memory blocks
+ * are onlined (memhp_default_state, or the blocks' state files as
+ * rmem-bench -N does).  The region must be aligned to the memory block
+ * size, the node must be possible, and the region must lie outside every
+ * /memory node: memory the kernel already knows, no-map included, has
+ * its sections and cannot be added again.  The node test compares memcpy
+ * between pages of that node and of normal RAM.
+ */
+#define TEST_NODE_RES	"System RAM (test_rmem_transfer)"
+
+#if IS_ENABLED(CONFIG_MEMORY_HOTREMOVE) && \
+	LINUX_VERSION_CODE >= KERNEL_VERSION(5, 8, 0)
+static void test_node_add(struct test_rmem_priv *priv)
+{
+	struct device *dev = priv->dev;
+	struct reserved_mem *rmem;
+	struct device_node *np;
+	int ret;
+
+	priv->node_nid = NUMA_NO_NODE;
+	if (rmem_node == NUMA_NO_NODE)
+		return;
+
+	np = of_parse_phandle(dev->of_node, "memory-region", 1);
+	rmem = np ? of_reserved_mem_lookup(np) : NULL;
+	of_node_put(np);
+	if (!rmem) {
+		dev_warn(dev, "NODE: no second memory-region to hotplug\n");
+		return;
+	}
+	if (rmem_node < 0 || rmem_node >= MAX_NUMNODES ||
+	    !node_possible(rmem_node)) {
+		dev_warn(dev, "NODE: node%d is not possible\n", rmem_node);
+		return;
+	}
+	if (!IS_ALIGNED(rmem->base | rmem->size, memory_block_size_bytes())) {
+		dev_warn(dev, "NODE: %pa+%pa is not aligned to memory blocks\n",
+			 &rmem->base, &rmem->size);
+		return;
+	}
+
+	/* outlives the module if the memory cannot be removed again */
+	priv->node_res = kstrdup(TEST_NODE_RES, GFP_KERNEL);
+	if (!priv->node_res)
+		return;
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5, 10, 0)
+	ret = add_memory_driver_managed(rmem_node, rmem->base, rmem->size,
+					priv->node_res);
+#else
+	ret = add_memory_driver_managed(rmem_node, rmem->base, rmem->size,
+					priv->node_res, MHP_NONE);
+#endif
+	if (ret) {
+		if (ret == -EEXIST)
+			dev_warn(dev, "NODE: %pa+%pa is already memory, move it out of /memory\n",
+				 &rmem->base, &rmem->size);
+		else
+			dev_warn(dev, "NODE: failed to add %pa+%pa (%d)\n",
+				 &rmem->base, &rmem->size, ret);
+		kfree(priv->node_res);
+		priv->node_res = NULL;
+		return;
+	}
+
+	priv->node_rmem = rmem;
+	priv->node_nid = rmem_node;
+	dev_info(dev, "NODE: %pa+%pa added to node%d\n", &rmem->base,
+		 &rmem->size, rmem_node);
+}
+
+static void test_node_remove(struct test_rmem_priv *priv)
+{
+	struct reserved_mem *rmem = priv->node_rmem;
+	int ret;
+
+	if (priv->node_nid == NUMA_NO_NODE)
+		return;
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5, 15, 0)
+	ret = offline_and_remove_memory(priv->node_nid, rmem->base, rmem->size);
+#else
+	ret = offline_and_remove_memory(rmem->base, rmem->size);
+#endif
+	if (ret) {
+		dev_warn(priv->dev, "NODE: %pa+%pa still in use (%d), leaving it\n",
+			 &rmem->base, &rmem->size, ret);
+		return;
+	}
+	kfree(priv->node_res);
+}
+#else
+static void test_node_add(struct test_rmem_priv *priv)
+{
+	priv->node_nid = NUMA_NO_NODE;
+	if (rmem_node != NUMA_NO_NODE)
+		dev_warn(priv->dev, "NODE: needs CONFIG_MEMORY_HOTREMOVE\n");
+}
+
+static void test_node_remove(struct test_rmem_priv *priv)
+{
+}
+#endif
+
+static void test_node_bench(struct test_rmem_priv *priv, const char *name,
+			    void *dst, const void *src)
+{
+	struct test_stat st;
+	unsigned int i;
+	u64 t0;
+
+	test_stat_init(&st);
+	for (i = 0; i < test_loops; i++) {
+		t0 = test_time_now(priv);
+		memcpy(dst, src, priv->len);
+		test_time_add(priv, &st, t0, 1);
+	}
+	test_stat_report(priv, name, priv->len, &st);
+}
+
+static int test_rmem_node(struct test_rmem_priv *priv)
+{
+	/* movable, as onlined blocks normally land in ZONE_MOVABLE */
+	gfp_t gfp = GFP_USER | __GFP_MOVABLE | __GFP_THISNODE | __GFP_NOWARN;
+	unsigned int order = get_order(priv->len);
+	int nid = priv->node_nid, ram = numa_mem_id();
+	struct page *pages[4] = {};
+	void *ram0, *ram1, *node0, *node1;
+	int i, ret = 0;
+
+	if (nid == NUMA_NO_NODE) {
+		dev_info(priv->dev, "NODE: no hotplugged node (rmem_node)\n");
+		return 0;
+	}
+	if (!node_state(nid, N_MEMORY)) {
+		dev_info(priv->dev, "NODE: node%d has no online memory yet\n",
+			 nid);
+		return 0;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(pages); i++) {
+		pages[i] = alloc_pages_node(i < 2 ? ram : nid, gfp, order);
+		if (!pages[i]) {
+			ret = -ENOMEM;
+			goto out;
+		}
+	}
+	ram0 = page_address(pages[0]);
+	ram1 = page_address(pages[1]);
+	node0 = page_address(pages[2]);
+	node1 = page_address(pages[3]);
+
+	memset(ram0, 0x5a, priv->len);
+	memset(node0, 0xa5, priv->len);
+	dev_info(priv->dev, "NODE: RAM node%d, region node%d\n", ram, nid);
+	test_node_bench(priv, "NODE memcpy ram->ram", ram1, ram0);
+	test_node_bench(priv, "NODE memcpy ram->node", node1, ram0);
+	test_node_bench(priv, "NODE memcpy node->ram", ram1, node0);
+	test_node_bench(priv, "NODE memcpy node->node", node1, node0);
+
+out:
+	for (i = 0; i < ARRAY_SIZE(pages); i++)
+		if (pages[i])
+			__free_pages(pages[i], order);
+	if (ret)
+		dev_err(priv->dev, "NODE: failed to allocate %zu bytes\n",
+			priv->len);
+
+	return ret;
+}
+
+/*
+ * Bandwidth map of the whole reserved region rather than the spot fixmem
+ * was allocated from.  The region is walked in heat_window sized windows;
+ * each window is saved, written and read heat_loops times by DMA and by
+ * the CPU through the region mappings the device node uses, probed for
+ * uncached load latency with a dependent pointer chase across it, and
+ * restored, so the calibration page and fixmem survive.  A region tail
+ * shorter than heat_window gets a short last window of its own.
+ * The scrubber is held off by priv->lock meanwhile.  Windows more than
+ * heat_pct percent below the region average are starred, to point at a
+ * slow bank, interleave or bus boundary.
+ */
+enum test_heat_op {
+	TEST_HEAT_DMA_WR,
+	TEST_HEAT_DMA_RD,
+	TEST_HEAT_CPU_WR,
+	TEST_HEAT_CPU_RD,
+	TEST_HEAT_NR_OPS,
+};
+
+struct test_heat {
+	void *va;
+	dma_addr_t dma;
+	dma_addr_t src_paddr;
+	dma_addr_t dst_paddr;
+	size_t win;
+	void *save;
+};
+
+struct test_heat_win {
+	size_t len;
+	u64 mbps[TEST_HEAT_NR_OPS];
+	u64 lat_ns;
+};
+
+static int test_heat_copy(struct test_rmem_priv *priv, struct test_heat *h,
+			  enum test_heat_op op, size_t off, size_t len)
+{
+	dma_addr_t region = h->dma + off;
+	struct device *chan_dev = priv->chan_dev;
+
+	switch (op) {
+	case TEST_HEAT_DMA_WR:
+		if (priv->chan_slave)
+			return test_slave_dma(priv->chan, DMA_MEM_TO_DEV,
+					      h->src_paddr, region, len);
+		return test_memcpy_dma(priv->chan, region, h->src_paddr, len);
+	case TEST_HEAT_DMA_RD:
+		if (priv->chan_slave)
+			return test_slave_dma(priv->chan, DMA_DEV_TO_MEM,
+					      h->dst_paddr, region, len);
+		return test_memcpy_dma(priv->chan, h->dst_paddr, region, len);
+	case TEST_HEAT_CPU_WR:
+		memcpy(h->va + off, priv->src_addr, len);
+		wmb();
+		return 0;
+	default:
+		dma_sync_single_for_cpu(chan_dev, h->dst_paddr, h->win,
+					DMA_FROM_DEVICE);
+		memcpy(priv->dst_addr, h->va + off, len);
+		dma_sync_single_for_device(chan_dev, h->dst_paddr, h->win,
+					   DMA_FROM_DEVICE);
+		return 0;
+	}
+}
+
+static int test_heat_window(struct test_rmem_priv *priv, struct test_heat *h,
+			    size_t off, struct test_heat_win *w)
+{
+	static const char * const names[] = {
+		[TEST_HEAT_DMA_WR] = "dma wr",
+		[TEST_HEAT_DMA_RD] = "dma rd",
+		[TEST_HEAT_CPU_WR] = "cpu wr",
+		[TEST_HEAT_CPU_RD] = "cpu rd",
+	};
+	/* the chase needs a power of two span for its mask */
+	size_t chase = rounddown_pow_of_two(w->len);
+	size_t stride = chase / TEST_TIME_BATCH, pos;
+	struct test_stat st;
+	char name[32];
+	unsigned int i, j;
+	int op, ret = 0;
+	u64 t0;
+
+	memcpy(h->save, h->va + off, w->len);
+
+	for (op = 0; op < TEST_HEAT_NR_OPS && !ret; op++) {
+		test_stat_init(&st);
+		for (i = 0; i < heat_loops; i++) {
+			t0 = test_time_now(priv);
+			ret = test_heat_copy(priv, h, op, off, w->len);
+			if (ret)
+				break;
+			test_time_add(priv, &st, t0, 1);
+		}
+		w->mbps[op] = st.sum ? div64_u64((u64)w->len * st.n * 1000,
+						 st.sum) : 0;
+		snprintf(name, sizeof(name), "HEAT %s +%#zx", names[op], off);
+		test_result_add(priv, name, w->len, &st);
+	}
+
+	/*
+	 * Uncached loads that each depend on the one before, chasing a cycle
+	 * of TEST_TIME_BATCH links spread over the window (7 is coprime to
+	 * it).  Masking keeps a corrupted link inside the window.
+	 */
+	if (stride < sizeof(u64))
+		goto out_restore;
+	for (j = 0; j < TEST_TIME_BATCH && !ret; j++)
+		*(u64 *)(h->va + off + j * stride) =
+			((j + 7) % TEST_TIME_BATCH) * stride;
+	wmb();
+	test_stat_init(&st);
+	for (i = 0; i < heat_loops && !ret; i++) {
+		pos = 0;
+		t0 = test_time_now(priv);
+		for (j = 0; j < TEST_TIME_BATCH; j++)
+			pos = READ_ONCE(*(u64 *)(h->va + off + pos)) &
+			      (chase - sizeof(u64));
+		test_time_add(priv, &st, t0, TEST_TIME_BATCH);
+	}
+	w->lat_ns = st.n ? st.min : 0;
+
+out_restore:
+	memcpy(h->va + off, h->save, w->len);
+	wmb();
+
+	return ret;
+}
+
+static int test_rmem_heat(struct test_rmem_priv *priv)
+{
+	struct device *dev = priv->dev;
+	struct device *chan_dev = priv->chan_dev;
+	u64 avg[TEST_HEAT_NR_OPS] = {};
+	struct test_heat h = {};
+	struct test_heat_win *w;
+	unsigned int nr, i, op;
+	char flag[TEST_HEAT_NR_OPS], tail[24];
+	size_t size, off;
+	int ret;
+
+	if (!priv->region_addr || !priv->region_dma) {
+		dev_info(dev, "HEAT: needs the reserved-memory region mapped\n");
+		return 0;
+	}
+	h.va = priv->region_addr;
+	h.dma = priv->region_dma;
+	size = priv->rmem->size;
+	/* power of two windows, so bank and interleave strides line up */
+	h.win = rounddown_pow_of_two(clamp_t(size_t, heat_window, PAGE_SIZE,
+					     min_t(size_t, priv->len, size)));
+	nr = DIV_ROUND_UP(size, h.win);
+
+	w = kvcalloc(nr, sizeof(*w), GFP_KERNEL);
+	h.save = kvmalloc(h.win, GFP_KERNEL);
+	ret = -ENOMEM;
+	if (!w || !h.save)
+		goto out_free;
+
+	test_memory_init(priv->src_addr, priv->fixmem_addr, priv->dst_addr,
+			 priv->len);
+	h.src_paddr = dma_map_single(chan_dev, priv->src_addr, h.win,
+				     DMA_TO_DEVICE);
+	ret = dma_mapping_error(chan_dev, h.src_paddr);
+	if (ret)
+		goto out_free;
+	h.dst_paddr = dma_map_single(chan_dev, priv->dst_addr, h.win,
+				     DMA_FROM_DEVICE);
+	ret = dma_mapping_error(chan_dev, h.dst_paddr);
+	if (ret)
+		goto out_unmap_src;
+
+	for (i = 0; i < nr && !ret; i++) {
+		off = (size_t)i * h.win;
+		w[i].len = min(h.win, size - off);
+		ret = test_heat_window(priv, &h, off, &w[i]);
+	}
+	if (ret) {
+		dev_err(dev, "HEAT: transfer at +%#zx failed (%d)\n",
+			(size_t)(i - 1) * h.win, ret);
+		goto out_unmap_dst;
+	}
+
+	for (op = 0; op < TEST_HEAT_NR_OPS; op++) {
+		for (i = 0; i < nr; i++)
+			avg[op] += w[i].mbps[op];
+		avg[op] = div_u64(avg[op], nr);
+	}
+
+	dev_info(dev, "HEAT: %pa+%#zx in %u windows of %#zx, MB/s dma wr/rd cpu wr/rd, ns per dependent load, * = %u%% below average\n",
+		 &priv->rmem->base, size, nr, h.win, heat_pct);
+	for (i = 0; i < nr; i++) {
+		for (op = 0; op < TEST_HEAT_NR_OPS; op++)
+			flag[op] = w[i].mbps[op] * 100 <
+				   avg[op] * (100 - min(heat_pct, 100U)) ? '*' : ' ';
+		tail[0] = '\0';
+		if (w[i].len != h.win)
+			snprintf(tail, sizeof(tail), " (%#zx bytes)", w[i].len);
+		dev_info(dev, "HEAT: +%#010zx %6llu%c %6llu%c %6llu%c %6llu%c %5llu ns%s\n",
+			 (size_t)i * h.win, w[i].mbps[0], flag[0],
+			 w[i].mbps[1], flag[1], w[i].mbps[2], flag[2],
+			 w[i].mbps[3], flag[3], w[i].lat_ns, tail);
+	}
+	dev_info(dev, "HEAT: average  %6llu  %6llu  %6llu  %6llu\n",
+		 avg[0], avg[1], avg[2], avg[3]);
+
+out_unmap_dst:
+	dma_unmap_single(chan_dev, h.dst_paddr, h.win, DMA_FROM_DEVICE);
+out_unmap_src:
+	dma_unmap_single(chan_dev, h.src_paddr, h.win, DMA_TO_DEVICE);
+out_free:
+	kvfree(h.save);
+	kvfree(w);
+
+	return ret;
+}
+
+static const struct {
+	unsigned int type;
+	int (*run)(struct test_rmem_priv *priv);
+} test_rmem_tests[] = {
+	{ TEST_TYPE_DMA, test_rmem_dma },
+	{ TEST_TYPE_CPU, test_rmem_cpu },
+	{ TEST_TYPE_SCHED, test_rmem_sched },
+	{ TEST_TYPE_NUMA, test_rmem_numa },
+	{ TEST_TYPE_SURVEY, test_rmem_survey },
+	{ TEST_TYPE_SLAVE, test_rmem_slave },
+	{ TEST_TYPE_TUNE, test_rmem_tune },
+	{ TEST_TYPE_FUSED, test_rmem_fused },
+	{ TEST_TYPE_SIZED, test_rmem_sized },
+	{ TEST_TYPE_TELEM, test_rmem_telem },
+	{ TEST_TYPE_RT, test_rmem_rt },
+	{ TEST_TYPE_SUBMIT, test_rmem_submit },
+	{ TEST_TYPE_PERCPU, test_rmem_percpu },
+	{ TEST_TYPE_HUGE, test_rmem_huge },
+	{ TEST_TYPE_FENCE, test_rmem_fence },
+	{ TEST_TYPE_ASYNC, test_rmem_async },
+	{ TEST_TYPE_PM, test_rmem_pm },
+	{ TEST_TYPE_REPLAY, test_rmem_replay },
+	{ TEST_TYPE_SAMPLE, test_rmem_sample },
+	{ TEST_TYPE_NODE, test_rmem_node },
+	{ TEST_TYPE_HEAT, test_rmem_heat },
+};
+
+static int test_rmem_run(struct test_rmem_priv *priv, unsigned int type)
+{
+	int i, err, ret = 0;
+
+	mutex_lock(&priv->lock);
+	test_fence_drain(priv, TEST_FENCE_TIMEOUT_MS);
+	priv->nr_results = 0;
+	test_time_calibrate(priv);
+	for (i = 0; i < ARRAY_SIZE(test_rmem_tests); i++) {
+		if (!(type & test_rmem_tests[i].type))
+			continue;
+		err = test_rmem_tests[i].run(priv);
+		if (err && !ret)
+			ret = err;
+	}
+	test_scrub_invalidate(priv, 0, priv->len);
+	mutex_unlock(&priv->lock);
+
+	return ret;
+}
+
+/*
+ * debugfs control interface: writing a test_type mask to "run" runs those
+ * tests, and "results" lists the measurements of the last run as
+ * "size samples min avg max MB/s name".
+ */
+static ssize_t test_run_write(struct file *file, const char __user *ubuf,
+			      size_t count, loff_t *ppos)
+{
+	struct test_rmem_priv *priv = file->private_data;
+	unsigned int type;
+	int ret;
+
+	ret = kstrtouint_from_user(ubuf, count, 0, &type);
+	if (ret)
+		return ret;
+
+	ret = test_rmem_run(priv, type);
+
+	return ret ? ret : count;
+}
+
+static const struct file_operations test_run_fops = {
+	.owner = THIS_MODULE,
+	.open = simple_open,
+	.write = test_run_write,
+};
+
+/* "trace" takes replay records; opening it with O_TRUNC drops the old ones */
+static int test_trace_open(struct inode *inode, struct file *file)
+{
+	struct test_rmem_priv *priv = inode->i_private;
+
+	file->private_data = priv;
+	if (file->f_flags & O_TRUNC) {
+		mutex_lock(&priv->lock);
+		test_trace_set(priv, NULL, 0);
+		mutex_unlock(&priv->lock);
+	}
+
+	return 0;
+}
+
+static ssize_t test_trace_write(struct file *file, const char __user *ubuf,
+				size_t count, loff_t *ppos)
+{
+	struct test_rmem_priv *priv = file->private_data;
+	size_t bytes;
+	u8 *trace;
+	int ret = 0;
+
+	mutex_lock(&priv->lock);
+	bytes = priv->trace_bytes + count;
+	if (bytes > TEST_TRACE_MAX_BYTES) {
+		ret = -EFBIG;
+		goto out_unlock;
+	}
+
+	trace = kvmalloc(bytes, GFP_KERNEL);
+	if (!trace) {
+		ret = -ENOMEM;
+		goto out_unlock;
+	}
+	if (copy_from_user(trace + priv->trace_bytes, ubuf, count)) {
+		kvfree(trace);
+		ret = -EFAULT;
+		goto out_unlock;
+	}
+	if (priv->trace_bytes)
+		memcpy(trace, priv->trace, priv->trace_bytes);
+
+	kvfree(priv->trace);
+	priv->trace = trace;
+	priv->trace_bytes = bytes;
+out_unlock:
+	mutex_unlock(&priv->lock);
+
+	return ret ? ret : count;
+}
+
+static const struct file_operations test_trace_fops = {
+	.owner = THIS_MODULE,
+	.open = test_trace_open,
+	.write = test_trace_write,
+};
+
+static int test_results_show(struct seq_file *s, void *unused)
+{
+	struct test_rmem_priv *priv = s->private;
+	struct test_result *res;
+	unsigned int i;
+
+	mutex_lock(&priv->lock);
+	for (i = 0; i < priv->nr_results; i++) {
+		res = &priv->results[i];
+		seq_printf(s, "%zu %u %llu %llu %llu %llu %s\n", res->size,
+			   res->n, res->min, res->avg, res->max, res->mbps,
+			   res->name);
+	}
+	mutex_unlock(&priv->lock);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(test_results);
+
+static void test_debugfs_init(struct test_rmem_priv *priv)
+{
+	priv->debugfs = debugfs_create_dir(dev_name(priv->dev), NULL);
+	debugfs_create_file("run", 0200, priv->debugfs, priv, &test_run_fops);
+	debugfs_create_file("results", 0400, priv->debugfs, priv,
+			    &test_results_fops);
+	debugfs_create_file("trace", 0200, priv->debugfs, priv,
+			    &test_trace_fops);
+}
+
+/*
+ * /dev/rmem-<device> maps the whole reserved region into userspace,
+ * write-combined like fixmem.  With mmap_huge set, faults on PMD (and PUD)
+ * aligned ranges are served with block mappings, counted in mmap_huge_maps,
+ * otherwise every page is mapped on its own.  The size is what
+ * lseek(SEEK_END) returns, and read/write/splice work on the same offsets.
+ * TEST_IOC_COPY queues a fenced copy job and returns a sync_file fd that
+ * signals when the copy is done.
+ *
+ * Open files hold a reference on test_mmap_dev, which outlives priv: on
+ * unbind priv is cleared under sem and the file operations that need it
+ * fail with -ENODEV from then on.  Faults only need the reserved_mem,
+ * which is never freed.  Writable mappings are counted there too, for the
+ * scrubber, without going through priv.
+ */
+static struct test_mmap_dev *test_mmap_dev(struct file *file)
+{
+	return container_of(file->private_data, struct test_mmap_dev, mdev);
+}
+
+/* priv with sem held for reading, or NULL once the device is unbound */
+static struct test_rmem_priv *test_mmap_get(struct file *file)
+{
+	struct test_mmap_dev *md = test_mmap_dev(file);
+
+	down_read(&md->sem);
+	if (!md->priv)
+		up_read(&md->sem);
+
+	return md->priv;
+}
+
+static void test_mmap_put(struct file *file)
+{
+	up_read(&test_mmap_dev(file)->sem);
+}
+
+static void test_mmap_release_dev(struct kref *ref)
+{
+	struct test_mmap_dev *md = container_of(ref, struct test_mmap_dev, ref);
+
+	kfree(md->mdev.name);
+	kfree(md);
+}
+
+static int test_mmap_open(struct inode *inode, struct file *file)
+{
+	/* misc_open() holds misc_mtx, so misc_deregister() waits for us */
+	kref_get(&test_mmap_dev(file)->ref);
+
+	return 0;
+}
+
+static int test_mmap_release(struct inode *inode, struct file *file)
+{
+	kref_put(&test_mmap_dev(file)->ref, test_mmap_release_dev);
+
+	return 0;
+}
+
+static vm_fault_t test_mmap_fault(struct vm_fault *vmf)
+{
+	struct vm_area_struct *vma = vmf->vma;
+	struct reserved_mem *rmem = test_mmap_dev(vma->vm_file)->rmem;
+
+	if (vmf->pgoff >= rmem->size >> PAGE_SHIFT)
+		return VM_FAULT_SIGBUS;
+
+	return vmf_insert_pfn(vma, vmf->address,
+			      PHYS_PFN(rmem->base) + vmf->pgoff);
+}
+
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+#if LINUX_VERSION_CODE < KERNEL_VERSION(6, 17, 0)
+#define test_pfn_t(pfn) __pfn_to_pfn_t(pfn, PFN_DEV)
+#else
+#define test_pfn_t(pfn) (pfn)
+#endif
+
+static vm_fault_t __test_mmap_huge_fault(struct vm_fault *vmf,
+					 unsigned int order)
+{
+	struct vm_area_struct *vma = vmf->vma;
+	struct reserved_mem *rmem = test_mmap_dev(vma->vm_file)->rmem;
+	unsigned long size = PAGE_SIZE << order;
+	unsigned long addr = ALIGN_DOWN(vmf->address, size);
+	unsigned long pgoff, pfn;
+	bool write = vmf->flags & FAULT_FLAG_WRITE;
+	vm_fault_t ret = VM_FAULT_FALLBACK;
+
+	if (!READ_ONCE(mmap_huge) || addr < vma->vm_start ||
+	    addr + size > vma->vm_end)
+		return VM_FAULT_FALLBACK;
+
+	pgoff = vma->vm_pgoff + ((addr - vma->vm_start) >> PAGE_SHIFT);
+	pfn = PHYS_PFN(rmem->base) + pgoff;
+	if (!IS_ALIGNED(pfn, 1UL << order) ||
+	    pgoff + (1UL << order) > rmem->size >> PAGE_SHIFT)
+		return VM_FAULT_FALLBACK;
+
+	if (order == PMD_SHIFT - PAGE_SHIFT)
+		ret = vmf_insert_pfn_pmd(vmf, test_pfn_t(pfn), write);
+#ifdef CONFIG_HAVE_ARCH_TRANSPARENT_HUGEPAGE_PUD
+	else if (order == PUD_SHIFT - PAGE_SHIFT)
+		ret = vmf_insert_pfn_pud(vmf, test_pfn_t(pfn), write);
+#endif
+
+	/* racing faults may lose a count, rmem-bench only needs non-zero */
+	if (ret == VM_FAULT_NOPAGE)
+		WRITE_ONCE(mmap_huge_maps, mmap_huge_maps + 1);
+
+	return ret;
+}
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(6, 6, 0)
+static vm_fault_t test_mmap_huge_fault(struct vm_fault *vmf,
+				       enum page_entry_size pe_size)
+{
+	switch (pe_size) {
+	case PE_SIZE_PMD:
+		return __test_mmap_huge_fault(vmf, PMD_SHIFT - PAGE_SHIFT);
+	case PE_SIZE_PUD:
+		return __test_mmap_huge_fault(vmf, PUD_SHIFT - PAGE_SHIFT);
+	default:
+		return VM_FAULT_FALLBACK;
+	}
+}
+#else
+static vm_fault_t test_mmap_huge_fault(struct vm_fault *vmf,
+				       unsigned int order)
+{
+	return __test_mmap_huge_fault(vmf, order);
+}
+#endif
+#endif /* CONFIG_TRANSPARENT_HUGEPAGE */
+
+/* mprotect() can make a shared mapping writable if VM_MAYWRITE is set */
+static void test_mmap_vm_open(struct vm_area_struct *vma)
+{
+	struct test_mmap_dev *md = test_mmap_dev(vma->vm_file);
+
+	if (vma->vm_flags & VM_MAYWRITE) {
+		atomic_inc(&md->writers);
+		atomic_inc(&md->map_gen);
+	}
+}
+
+static void test_mmap_vm_close(struct vm_area_struct *vma)
+{
+	struct test_mmap_dev *md = test_mmap_dev(vma->vm_file);
+
+	if (vma->vm_flags & VM_MAYWRITE) {
+		atomic_inc(&md->map_gen);
+		atomic_dec(&md->writers);
+	}
+}
+
+static const struct vm_operations_struct test_mmap_vm_ops = {
+	.open = test_mmap_vm_open,
+	.close = test_mmap_vm_close,
+	.fault = test_mmap_fault,
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	.huge_fault = test_mmap_huge_fault,
+#endif
+};
+
+static int test_mmap_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct reserved_mem *rmem = test_mmap_dev(file)->rmem;
+	unsigned long pages = vma_pages(vma);
+
+	if (vma->vm_pgoff > rmem->size >> PAGE_SHIFT ||
+	    pages > (rmem->size >> PAGE_SHIFT) - vma->vm_pgoff)
+		return -EINVAL;
+	if (is_cow_mapping(vma->vm_flags))
+		return -EINVAL;
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(6, 3, 0)
+	vma->vm_flags |= VM_PFNMAP | VM_DONTEXPAND | VM_DONTDUMP;
+#else
+	vm_flags_set(vma, VM_PFNMAP | VM_DONTEXPAND | VM_DONTDUMP);
+#endif
+	vma->vm_page_prot = pgprot_writecombine(vma->vm_page_prot);
+	vma->vm_ops = &test_mmap_vm_ops;
+	test_mmap_vm_open(vma);
+
+	return 0;
+}
+
+/*
+ * read/write at file offsets into the region, and splice through them.
+ * Page-backed iterators (splice and sendfile hand over bvecs) are copied
+ * page by page with memcpy DMA when a memcpy channel is mapped to the
+ * region and splice_dma is set; anything else, and user buffers, are
+ * copied by the CPU through a write-combined mapping of the region.
+ */
+static ssize_t test_rw_dma(struct test_rmem_priv *priv, struct iov_iter *iter,
+			   loff_t pos, size_t count, bool write)
+{
+	enum dma_data_direction dir = write ? DMA_TO_DEVICE : DMA_FROM_DEVICE;
+	struct device *chan_dev = priv->chan_dev;
+	const struct bio_vec *bv;
+	dma_addr_t page_dma, region;
+	size_t len, done = 0;
+	int ret = 0;
+
+	while (done < count) {
+		bv = iter->bvec;
+		len = min_t(size_t, bv->bv_len - iter->iov_offset, count - done);
+		page_dma = dma_map_page(chan_dev, bv->bv_page,
+					bv->bv_offset + iter->iov_offset, len, dir);
+		ret = dma_mapping_error(chan_dev, page_dma);
+		if (ret)
+			break;
+
+		region = priv->region_dma + pos + done;
+		ret = write ? test_memcpy_dma(priv->chan, region, page_dma, len) :
+			      test_memcpy_dma(priv->chan, page_dma, region, len);
+		dma_unmap_page(chan_dev, page_dma, len, dir);
+		if (ret)
+			break;
+
+		iov_iter_advance(iter, len);
+		done += len;
+	}
+
+	return done ? done : ret;
+}
+
+static ssize_t test_rw_iter(struct kiocb *iocb, struct iov_iter *iter,
+			    bool write)
+{
+	struct test_rmem_priv *priv;
+	size_t size = test_mmap_dev(iocb->ki_filp)->rmem->size, fix_off, count;
+	enum test_engine eng = TEST_ENG_CPU;
+	loff_t pos = iocb->ki_pos;
+	ssize_t ret;
+	u64 t0;
+
+	if (pos >= size)
+		return write && iov_iter_count(iter) ? -ENOSPC : 0;
+	count = min_t(size_t, iov_iter_count(iter), size - pos);
+	if (!count)
+		return 0;
+
+	priv = test_mmap_get(iocb->ki_filp);
+	if (!priv)
+		return -ENODEV;
+
+	mutex_lock(&priv->lock);
+	if (iov_iter_is_bvec(iter) && priv->region_dma && !priv->chan_slave &&
+	    READ_ONCE(splice_dma)) {
+		/* test_dma_wait() terminates the channel fenced copies share */
+		test_fence_drain(priv, TEST_FENCE_TIMEOUT_MS);
+		eng = TEST_ENG_DMA;
+		t0 = ktime_get_ns();
+		ret = test_rw_dma(priv, iter, pos, count, write);
+	} else {
+		t0 = ktime_get_ns();
+		ret = write ?
+		      copy_from_iter(priv->region_addr + pos, count, iter) :
+		      copy_to_iter(priv->region_addr + pos, count, iter);
+	}
+	if (!ret)
+		ret = -EFAULT;
+	test_telem_account(priv, eng, write ? TEST_DIR_TO_FIX : TEST_DIR_FROM_FIX,
+			   ret > 0 ? ret : 0, ktime_get_ns() - t0,
+			   ret < 0 ? ret : 0);
+
+	/* the scrubber's checksums of fixmem are stale where we wrote */
+	fix_off = priv->fixmem_phys - priv->rmem->base;
+	if (write && ret > 0 && pos < fix_off + priv->len && pos + ret > fix_off)
+		test_scrub_invalidate(priv, max_t(loff_t, pos, fix_off) - fix_off,
+				      min_t(loff_t, pos + ret, fix_off + priv->len) -
+				      max_t(loff_t, pos, fix_off));
+	mutex_unlock(&priv->lock);
+	test_mmap_put(iocb->ki_filp);
+
+	if (ret > 0)
+		iocb->ki_pos += ret;
+
+	return ret;
+}
+
+static ssize_t test_mmap_read_iter(struct kiocb *iocb, struct iov_iter *iter)
+{
+	return test_rw_iter(iocb, iter, false);
+}
+
+static ssize_t test_mmap_write_iter(struct kiocb *iocb, struct iov_iter *iter)
+{
+	return test_rw_iter(iocb, iter, true);
+}
+
+#if IS_ENABLED(CONFIG_SYNC_FILE)
+static long test_mmap_ioctl(struct file *file, unsigned int cmd,
+			    unsigned long arg)
+{
+	struct test_rmem_priv *priv;
+	void __user *uarg = (void __user *)arg;
+	struct test_ioc_copy req;
+	struct dma_fence *fence;
+	struct sync_file *sync;
+	int fd, ret;
+
+	if (cmd != TEST_IOC_COPY)
+		return -ENOTTY;
+	if (copy_from_user(&req, uarg, sizeof(req)))
+		return -EFAULT;
+	if (req.dir > TEST_IOC_FROM_FIX || req.flags)
+		return -EINVAL;
+
+	fd = get_unused_fd_flags(O_CLOEXEC);
+	if (fd < 0)
+		return fd;
+
+	priv = test_mmap_get(file);
+	if (!priv) {
+		ret = -ENODEV;
+		goto err_put_fd;
+	}
+	if (req.offset > priv->len || req.len > priv->len - req.offset) {
+		fence = ERR_PTR(-EINVAL);
+	} else {
+		mutex_lock(&priv->lock);
+		fence = test_fence_submit(priv, req.dir == TEST_IOC_TO_FIX,
+					  req.offset, req.len);
+		mutex_unlock(&priv->lock);
+	}
+	test_mmap_put(file);
+	if (IS_ERR(fence)) {
+		ret = PTR_ERR(fence);
+		goto err_put_fd;
+	}
+
+	sync = sync_file_create(fence);
+	dma_fence_put(fence);
+	if (!sync) {
+		ret = -ENOMEM;
+		goto err_put_fd;
+	}
+
+	req.fence_fd = fd;
+	if (copy_to_user(uarg, &req, sizeof(req))) {
+		fput(sync->file);
+		ret = -EFAULT;
+		goto err_put_fd;
+	}
+	fd_install(fd, sync->file);
+
+	return 0;
+
+err_put_fd:
+	put_unused_fd(fd);
+
+	return ret;
+}
+#endif
+
+static loff_t test_mmap_llseek(struct file *file, loff_t offset, int whence)
+{
+	return fixed_size_llseek(file, offset, whence,
+				 test_mmap_dev(file)->rmem->size);
+}
+
+static const struct file_operations test_mmap_fops = {
+	.owner = THIS_MODULE,
+	.open = test_mmap_open,
+	.release = test_mmap_release,
+	.mmap = test_mmap_mmap,
+	.llseek = test_mmap_llseek,
+	.get_unmapped_area = thp_get_unmapped_area,
+	.read_iter = test_mmap_read_iter,
+	.write_iter = test_mmap_write_iter,
+#if LINUX_VERSION_CODE < KERNEL_VERSION(6, 5, 0)
+	.splice_read = generic_file_splice_read,
+#else
+	.splice_read = copy_splice_read,
+#endif
+	.splice_write = iter_file_splice_write,
+#if IS_ENABLED(CONFIG_SYNC_FILE)
+	.unlocked_ioctl = test_mmap_ioctl,
+	.compat_ioctl = compat_ptr_ioctl,
+#endif
+};
+
+/*
+ * The whole region, write-combined for the CPU and mapped for the channel,
+ * shared by the device node and the heat test.
+ */
+static void test_region_map(struct test_rmem_priv *priv)
+{
+	if (!priv->rmem)
+		return;
+
+	priv->region_addr = memremap(priv->rmem->base, priv->rmem->size,
+				     MEMREMAP_WC);
+	if (!priv->region_addr)
+		return;
+
+	priv->region_dma = dma_map_resource(priv->chan_dev, priv->rmem->base,
+					    priv->rmem->size,
+					    DMA_BIDIRECTIONAL, 0);
+	if (dma_mapping_error(priv->chan_dev, priv->region_dma))
+		priv->region_dma = 0;
+}
+
+static void test_region_unmap(struct test_rmem_priv *priv)
+{
+	if (priv->region_dma)
+		dma_unmap_resource(priv->chan_dev, priv->region_dma,
+				   priv->rmem->size, DMA_BIDIRECTIONAL, 0);
+	if (priv->region_addr)
+		memunmap(priv->region_addr);
+}
+
+static void test_mmap_init(struct test_rmem_priv *priv)
+{
+	struct test_mmap_dev *md;
+	int ret;
+
+	if (!priv->region_addr)
+		return;
+
+	md = kzalloc(sizeof(*md), GFP_KERNEL);
+	if (!md)
+		return;
+	kref_init(&md->ref);
+	init_rwsem(&md->sem);
+	md->priv = priv;
+	md->rmem = priv->rmem;
+	md->mdev.minor = MISC_DYNAMIC_MINOR;
+	md->mdev.name = kasprintf(GFP_KERNEL, "rmem-%s", dev_name(priv->dev));
+	md->mdev.fops = &test_mmap_fops;
+	md->mdev.parent = priv->dev;
+	if (!md->mdev.name)
+		goto err_put;
+
+	ret = misc_register(&md->mdev);
+	if (ret) {
+		dev_warn(priv->dev, "failed to register %s (%d)\n",
+			 md->mdev.name, ret);
+		goto err_put;
+	}
+	priv->mmap_dev = md;
+
+	return;
+
+err_put:
+	kref_put(&md->ref, test_mmap_release_dev);
+}
+
+static void test_mmap_exit(struct test_rmem_priv *priv)
+{
+	struct test_mmap_dev *md = priv->mmap_dev;
+
+	if (!md)
+		return;
+
+	misc_deregister(&md->mdev);
+	/* wait out the file operations in progress, fail the later ones */
+	down_write(&md->sem);
+	md->priv = NULL;
+	up_write(&md->sem);
+	/* the scrubber looks at md under priv->lock */
+	mutex_lock(&priv->lock);
+	priv->mmap_dev = NULL;
+	mutex_unlock(&priv->lock);
+	kref_put(&md->ref, test_mmap_release_dev);
+}
+
+static ssize_t scrub_bytes_show(struct device *dev,
+				struct device_attribute *attr, char *buf)
+{
+	struct test_rmem_priv *priv = dev_get_drvdata(dev);
+
+	return sysfs_emit(buf, "%lld\n", atomic64_read(&priv->scrub_bytes));
+}
+static DEVICE_ATTR_RO(scrub_bytes);
+
+static ssize_t scrub_mismatches_show(struct device *dev,
+				     struct device_attribute *attr, char *buf)
+{
+	struct test_rmem_priv *priv = dev_get_drvdata(dev);
+
+	return sysfs_emit(buf, "%lld\n", atomic64_read(&priv->scrub_mismatches));
+}
+static DEVICE_ATTR_RO(scrub_mismatches);
+
+static ssize_t scrub_passes_show(struct device *dev,
+				 struct device_attribute *attr, char *buf)
+{
+	struct test_rmem_priv *priv = dev_get_drvdata(dev);
+
+	return sysfs_emit(buf, "%lld\n", atomic64_read(&priv->scrub_passes));
+}
+static DEVICE_ATTR_RO(scrub_passes);
+
+static ssize_t tune_show(struct device *dev,
+			 struct device_attribute *attr, char *buf)
+{
+	struct test_rmem_priv *priv = dev_get_drvdata(dev);
+	struct test_tune_cfg *cfg;
+	ssize_t len = 0;
+	unsigned int i;
+
+	mutex_lock(&priv->lock);
+	for (i = 0; i < priv->nr_tune; i++) {
+		cfg = &priv->tune[i];
+		len += sysfs_emit_at(buf, len, "%zu %u %u %u %u %llu\n",
+				     cfg->size, cfg->depth, cfg->chunk,
+				     cfg->nr_chans, cfg->cpu_pct, cfg->ns);
+	}
+	mutex_unlock(&priv->lock);
+
+	return len;
+}
+static DEVICE_ATTR_RO(tune);
+
+static const char * const test_eng_names[] = { "cpu", "dma" };
+static const char * const test_dir_names[] = { "to_fix", "from_fix" };
+
+/* one line per engine and direction: bytes ops errors lat[0..15] */
+static ssize_t telemetry_show(struct device *dev,
+			      struct device_attribute *attr, char *buf)
+{
+	struct test_rmem_priv *priv = dev_get_drvdata(dev);
+	struct test_telem_ctr *ctr;
+	struct test_telem *sum;
+	ssize_t len = 0;
+	int e, d, b;
+
+	sum = kmalloc(sizeof(*sum), GFP_KERNEL);
+	if (!sum)
+		return -ENOMEM;
+
+	test_telem_sum(priv, sum);
+	for (e = 0; e < TEST_ENG_NR; e++) {
+		for (d = 0; d < TEST_DIR_NR; d++) {
+			ctr = &sum->ctr[e][d];
+			len += sysfs_emit_at(buf, len, "%s %s %llu %llu %llu",
+					     test_eng_names[e],
+					     test_dir_names[d], ctr->bytes,
+					     ctr->ops, ctr->errors);
+			for (b = 0; b < TEST_TELEM_BUCKETS; b++)
+				len += sysfs_emit_at(buf, len, " %llu",
+						     ctr->lat[b]);
+			len += sysfs_emit_at(buf, len, "\n");
+		}
+	}
+	kfree(sum);
+
+	return len;
+}
+static DEVICE_ATTR_RO(telemetry);
+
+static struct attribute *test_rmem_attrs[] = {
+	&dev_attr_scrub_bytes.attr,
+	&dev_attr_scrub_mismatches.attr,
+	&dev_attr_scrub_passes.attr,
+	&dev_attr_tune.attr,
+	&dev_attr_telemetry.attr,
+	NULL
+};
+ATTRIBUTE_GROUPS(test_rmem);
+
+static int test_rmem_trasnfer_probe(struct platform_device *pdev)
+{
+	struct device *dev = &pdev->dev;
+	struct test_rmem_priv *priv;
+	struct device_node *np;
+	struct device *chan_dev;
+	struct dma_chan *chan;
+	size_t len = test_buf_size;
+	int ret = 0;
+
+	dev_info(dev, "transfer test for reserved-memory\n");
+
+	priv = devm_kzalloc(dev, sizeof(*priv), GFP_KERNEL);
+	if (!priv)
+		return -ENOMEM;
+	priv->dev = dev;
+	priv->len = len;
+	mutex_init(&priv->lock);
+	test_fence_init(priv);
+
+	priv->telem = devm_alloc_percpu(dev, struct test_telem);
+	if (!priv->telem)
+		return -ENOMEM;
+
+	np = of_parse_phandle(dev->of_node, "memory-region", 0);
+	priv->rmem = np ? of_reserved_mem_lookup(np) : NULL;
+	of_node_put(np);
+
+	/* Request DMA channel, preferably local to the reserved region */
+	priv->node = test_region_node(priv);
+	chan = chan_numa ? test_request_chan(priv->node, true) : NULL;
+	if (!chan)
+		chan = test_request_chan(NUMA_NO_NODE, true);
+
+	/* Optional slave channel, used alone if no memcpy channel exists */
+	priv->slave_chan = dma_request_chan(dev, "rmem");
+	if (IS_ERR(priv->slave_chan)) {
+		ret = PTR_ERR(priv->slave_chan);
+		priv->slave_chan = NULL;
+		if (ret == -EPROBE_DEFER)
+			goto out_release_chan;
+	}
+	if (!chan && priv->slave_chan) {
+		chan = priv->slave_chan;
+		priv->chan_slave = true;
+		dev_info(dev, "no memcpy channel, using slave %s\n",
+			 dma_chan_name(chan));
+	}
+
+	if (!chan) {
+		dev_err(dev, "Failed to request dma channel\n");
+		return -EPROBE_DEFER;
+	}
+	chan_dev = dmaengine_get_dma_device(chan);
+	priv->chan = chan;
+	priv->chan_dev = chan_dev;
+
+	/* Fixed memory */
+	ret = of_reserved_mem_device_init_by_idx(chan_dev, dev->of_node, 0);
+	if (ret) {
+		dev_err(dev, "No memory-region found for index 0\n");
+		goto out_release_chan;
+	}
+
+	priv->src_addr = devm_kmalloc(dev, len, GFP_KERNEL);
+	if (!priv->src_addr) {
+		ret = -ENOMEM;
+		goto out_unreg_fixmem;
+	}
+
+	priv->dst_addr = devm_kmalloc(dev, len, GFP_KERNEL);
+	if (!priv->dst_addr) {
+		ret = -ENOMEM;
+		goto out_free_src;
+	}
+
+	test_calib_init(priv);
+	test_node_add(priv);
+
+	priv->attrs = DMA_ATTR_FORCE_CONTIGUOUS;
+	priv->fixmem_addr = dma_alloc_attrs(chan_dev, len, &priv->fixmem_paddr,
+					    GFP_KERNEL, priv->attrs);
+	if (!priv->fixmem_addr) {
+		ret = -ENOMEM;
+		goto out_free_calib;
+	}
+	priv->fixmem_phys = test_pool_phys(priv->fixmem_addr);
+	if (priv->rmem && (priv->fixmem_phys < priv->rmem->base ||
+			   priv->fixmem_phys - priv->rmem->base >= priv->rmem->size))
+		dev_warn(dev, "fixmem %pa outside the reserved region\n",
+			 &priv->fixmem_phys);
+
+	test_region_map(priv);
+
+	ret = test_rmem_run(priv, test_type);
+	if (ret)
+		goto out_unmap_region;
+
+	ret = test_scrub_start(priv);
+	if (ret)
+		goto out_unmap_region;
+
+	test_debugfs_init(priv);
+	test_stream_start(priv);
+	test_mmap_init(priv);
+	platform_set_drvdata(pdev, priv);
+
+	return 0;
+
+out_unmap_region:
+	test_region_unmap(priv);
+	dma_free_attrs(chan_dev, len, priv->fixmem_addr, priv->fixmem_paddr,
+		       priv->attrs);
+out_free_calib:
+	test_node_remove(priv);
+	test_calib_exit(priv);
+	devm_kfree(dev, priv->dst_addr);
+out_free_src:
+	devm_kfree(dev, priv->src_addr);
+out_unreg_fixmem:
+	of_reserved_mem_device_release(chan_dev);
+out_release_chan:
+	if (chan && chan != priv->slave_chan)
+		dma_release_channel(chan);
+	if (priv->slave_chan)
+		dma_release_channel(priv->slave_chan);
+
+	return ret;
+}
+
+static void __test_rmem_trasnfer_remove(struct platform_device *pdev)
+{
+	struct test_rmem_priv *priv = platform_get_drvdata(pdev);
+
+	test_mmap_exit(priv);
+	test_fence_drain(priv, TEST_FENCE_TIMEOUT_MS);
+	test_stream_stop(priv);
+	debugfs_remove_recursive(priv->debugfs);
+	test_scrub_stop(priv);
+	test_region_unmap(priv);
+	dma_free_attrs(priv->chan_dev, priv->len, priv->fixmem_addr,
+		       priv->fixmem_paddr, priv->attrs);
+	test_node_remove(priv);
+	test_calib_exit(priv);
+	kvfree(priv->trace);
+	of_reserved_mem_device_release(priv->chan_dev);
+	if (!priv->chan_slave)
+		dma_release_channel(priv->chan);
+	if (priv->slave_chan)
+		dma_release_channel(priv->slave_chan);
+}
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(6, 11, 0)
+static int test_rmem_trasnfer_remove(struct platform_device *pdev)
+{
+	__test_rmem_trasnfer_remove(pdev);
+	return 0;
+}
+#else
+static void test_rmem_trasnfer_remove(struct platform_device *pdev)
+{
+	__test_rmem_trasnfer_remove(pdev);
+}
+#endif
+
 static const struct of_device_id test_rmem_trasnfer_of_match[] = {
 	{ .compatible = "test-rmem-transfer", },
 	{ /* Sentinel */ }
@@ -215,9 +5555,11 @@ MODULE_DEVICE_TABLE(of, test_rmem_trasnfer_of_match);
 
 static struct platform_driver test_rmem_trasnfer_driver = {
 	.probe = test_rmem_trasnfer_probe,
+	.remove = test_rmem_trasnfer_remove,
 	.driver	= {
 		.name = "test-rmem-trasnfer",
 		.of_match_table	= test_rmem_trasnfer_of_match,
+		.dev_groups = test_rmem_groups,
 	},
 };
 